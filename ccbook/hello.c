@@ -1,9 +1,10 @@
 /* hello.c */
 #pragma GCC diagnostic ignored "-Wunused-variable"
 
-#include <stdio.h>
 #include "poly/thread.h"
 
+#include <stdio.h>
+
 typedef atomic(bool) Flag;
 
 struct Hello {
@@ -1,9 +1,10 @@
 /* printer1.c */
 #pragma GCC diagnostic ignored "-Wunused-variable"
 
-#include <stdio.h>
 #include "poly/thread.h"
 
+#include <stdio.h>
+
 typedef atomic(bool) Flag;
 
 struct Printer1 {
@@ -1,8 +1,9 @@
 /* printer2.c */
 
-#include <stdio.h>
 #include "poly/thread.h"
 
+#include <stdio.h>
+
 typedef atomic(short) Counter;
 
 struct Printer2 {
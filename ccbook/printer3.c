@@ -1,10 +1,11 @@
 /* printer3.c */
 
-#include <stdio.h>
 #include "poly/thread.h"
 #include "poly/passing/entry.h"
 #include "poly/passing/task.h"
 
+#include <stdio.h>
+
 typedef struct {
 	Entry print;
 } _Printer3;
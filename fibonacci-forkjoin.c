@@ -0,0 +1,79 @@
+// Fork-join test
+// gcc -Wall -O2 -lpthread filename.c
+
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+// comment next line to disable assertions
+#define DEBUG
+
+#include "poly/executor.h"
+#include "poly/forkjoin.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+////////////////////////////////////////////////////////////////////////
+// Compute fib(n) spawning both recursive calls
+////////////////////////////////////////////////////////////////////////
+
+enum { CUTOFF=20 }; // below, serial
+
+struct Fib {
+	long  n;
+	long* result;
+};
+
+int Fib(void* data)
+{
+	struct Fib const this = *(struct Fib*)data;
+
+	auto long slow_fib(long x) {
+		if (x < 2) { return x; }
+		return slow_fib(x-1) + slow_fib(x-2);
+	}
+
+	if (this.n < CUTOFF) {
+		*this.result = slow_fib(this.n);
+		return 0;
+	}
+
+	long x, y;
+	Join j;
+	join_init(&j);
+	spawn(&j, Fib, .n=this.n-1, .result=&x);
+	spawn(&j, Fib, .n=this.n-2, .result=&y);
+	join_sync(&j);
+	*this.result = x + y;
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char* argv[argc+1])
+{
+	int err = 0;
+
+	enum { N=40 }; // fib(40)=102334155
+	long n = (argc == 1) ? N : atol(argv[1]);
+	Clock t = now();
+
+	Executor executor;
+	err = executor_init(&executor, 0); // one worker per core
+	assert(err == 0);
+
+	long result;
+	submit(&executor, Fib, .n=n, .result=&result);
+	err = executor_wait(&executor);
+	assert(err == 0);
+	executor_destroy(&executor);
+
+	printf("Fibonacci(%ld) = %ld\n", n, result);
+	printf("ms: %lld\n", ns2ms(now()-t));
+
+	return 0;
+}
+
+// vim:ai:sw=4:ts=4:syntax=cpp
@@ -1,14 +1,14 @@
 // Spinner test
 // gcc -Wall -O2 -lpthread filename.c
 
-#include <stdio.h>
-
 // comment next line to disable assertions
 #define DEBUG
 
 #include "poly/thread.h"
 #include "poly/scalar.h"
-#include "poly/passing/channel.h"
+#include "poly/passing/future.h"
+
+#include <stdio.h>
 
 ////////////////////////////////////////////////////////////////////////
 
@@ -58,7 +58,7 @@ int Spinner(void* data)
 
 struct Fibonacci {
 	THREAD_TYPE
-	Channel* future;
+	Future*  future;
 	long     n;
 };
 
@@ -76,8 +76,7 @@ int Fibonacci(void* data)
 
 	long result = slow_fib(this.n);
 	// ...long time...
-	channel_send(this.future, (Unsigned)result); // what if error: return > 0 ???
-												 //
+	future_set(this.future, (Unsigned)result);
 	END_BODY
 }
 
@@ -105,14 +104,14 @@ int main(int argc, char* argv[argc+1])
 
 	run_thread(Spinner, .delay=us2ns(usDELAY));
 
-	Channel inbox;
-	err += channel_init(&inbox, 1);
+	Future inbox;
+	err += future_init(&inbox);
 	run_promise(Fibonacci, &inbox, .n=N);
 
 	assert(err == 0);
 
 	Scalar r;
-	err = channel_receive(&inbox, &r);
+	err = future_get(&inbox, &r);
 	assert(err == 0);
 	long n = cast(r, long);
 	assert(n == 1836311903ul);
@@ -127,7 +126,7 @@ int main(int argc, char* argv[argc+1])
 
 	show_cursor();
 
-	channel_destroy(&inbox);
+	future_destroy(&inbox);
 
 	return 0;
 }
@@ -15,6 +15,20 @@
 #define NDEBUG
 #endif
 
+// Fibers and timer wheel timeouts are built on the futex backend
+#if (defined(POLY_FIBERS) || defined(POLY_TIMER_WHEEL)) && !defined(POLY_FUTEX)
+#define POLY_FUTEX
+#endif
+
+// POSIX and GNU calls (monotonic clock, futexes, thread attributes) also
+// with -std=c11/c17: include POLY headers before any system header
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#if defined(_FEATURES_H) && !defined(__USE_MISC)
+#error Include POLY headers before any system header, or define _GNU_SOURCE
+#endif
+
 #include <assert.h>
 #include <errno.h>
 #include <error.h>
@@ -74,6 +88,17 @@ static_assert(STATUS_TIMEDOUT >= 0);
 // private tricks
 #define POLY_TRANSPARENT __attribute__((__transparent_union__))
 
+// keep fields written by different threads apart
+#define CACHE_LINE      64
+#define CACHE_ALIGNED   _Alignas(CACHE_LINE)
+
+// smallest power of two >= n
+static ALWAYS inline unsigned
+pow2_ceil (unsigned n)
+{
+	return (n <= 1) ? 1 : 1u << (32 - __builtin_clz(n-1));
+}
+
 ////////////////////////////////////////////////////////////////////////
 // Clock time measured in nanoseconds
 ////////////////////////////////////////////////////////////////////////
@@ -87,13 +112,24 @@ typedef signed long long Clock;
 #define ns2ms(T)    (Clock)((T)/1000000ull)
 #define ns2us(T)    (Clock)((T)/1000ull)
 
-// TIME_UTC based absolute calendar time point in nanoseconds
+/*
+ * Monotonic time point in nanoseconds, the base of all deadlines: it never
+ * jumps with clock adjustments. See clock.h for cheaper timestamps and the
+ * calendar time.
+ */
 static inline Clock
 now (void)
 {
 	struct timespec ts;
-	timespec_get(&ts, TIME_UTC);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 	return s2ns(ts.tv_sec) + ts.tv_nsec;
 }
 
+// Split `t` nanoseconds to make a `struct timespec`
+static ALWAYS inline struct timespec
+ns2timespec (Clock t)
+{
+	return (struct timespec){ .tv_sec=ns2s(t), .tv_nsec=t - s2ns(ns2s(t)) };
+}
+
 #endif // vim:ai:sw=4:ts=4:syntax=cpp
@@ -0,0 +1,167 @@
+#ifndef POLY_DEQUE_H
+#define POLY_DEQUE_H
+
+#ifndef POLY_H
+#include "POLY.h"
+#endif
+#include "atomics.h"
+
+//#include <stdlib.h>
+extern void  free(void*);
+extern void* malloc(size_t);
+
+/*
+ * Chase-Lev work-stealing deque of pointers (with the C11 memory orders
+ * of Lê, Pop, Cohen and Zappa Nardelli). The owner thread pushes and takes
+ * at the bottom; any other thread steals at the top. The array grows when
+ * full; replaced arrays may still be read by thieves, so they are kept
+ * until the deque is destroyed.
+ */
+
+////////////////////////////////////////////////////////////////////////
+// Deque interface
+////////////////////////////////////////////////////////////////////////
+
+struct DequeArray {
+	struct DequeArray* retired; // previous (smaller) array
+	signed long long   size;    // power of two
+	atomic(void*)      slot[];
+};
+
+typedef struct Deque {
+	CACHE_ALIGNED
+	atomic(signed long long)   top;    // thieves side
+	CACHE_ALIGNED
+	atomic(signed long long)   bottom; // owner side
+	atomic(struct DequeArray*) array;
+} Deque;
+
+// `deque_steal` result when losing a race (retrying may succeed)
+#define DEQUE_ABORT ((void*)-1)
+
+static int   deque_init(Deque *const this, unsigned capacity);
+static void  deque_destroy(Deque *const this);
+static bool  deque_empty(Deque const*const this);
+static int   deque_push(Deque *const this, void* item);
+static void* deque_take(Deque *const this);
+static void* deque_steal(Deque *const this);
+
+////////////////////////////////////////////////////////////////////////
+// Deque implementation
+////////////////////////////////////////////////////////////////////////
+
+static inline struct DequeArray*
+deque_array_ (signed long long size, struct DequeArray* retired)
+{
+	struct DequeArray *const a = malloc(sizeof(struct DequeArray) + size*sizeof(atomic(void*)));
+	if (a != NULL) {
+		a->retired = retired;
+		a->size = size;
+	}
+	return a;
+}
+
+static int
+deque_init (Deque *const this, unsigned capacity)
+{
+	struct DequeArray *const a = deque_array_(pow2_ceil(capacity), NULL);
+	if (a == NULL) {
+		return STATUS_NOMEM;
+	}
+	STORE(&this->top, 0, RELAXED);
+	STORE(&this->bottom, 0, RELAXED);
+	STORE(&this->array, a, RELAXED);
+
+	return STATUS_SUCCESS;
+}
+
+static void
+deque_destroy (Deque *const this)
+{
+	struct DequeArray* a = LOAD(&this->array, RELAXED);
+	while (a != NULL) {
+		struct DequeArray *const retired = a->retired;
+		free(a);
+		a = retired;
+	}
+	STORE(&this->array, NULL, RELAXED);
+}
+
+// A snapshot when called from a thief
+static ALWAYS inline bool
+deque_empty (Deque const*const this)
+{
+	return LOAD(&this->bottom, RELAXED) <= LOAD(&this->top, RELAXED);
+}
+
+// Owner side: STATUS_NOMEM if the array must grow and cannot
+static inline int
+deque_push (Deque *const this, void* item)
+{
+	signed long long const b = LOAD(&this->bottom, RELAXED);
+	signed long long const t = LOAD(&this->top, ACQUIRE);
+	struct DequeArray* a = LOAD(&this->array, RELAXED);
+
+	if (b - t > a->size - 1) { // full: copy to an array twice as large
+		struct DequeArray *const g = deque_array_(2*a->size, a);
+		if (g == NULL) {
+			return STATUS_NOMEM;
+		}
+		for (signed long long i = t; i < b; ++i) {
+			STORE(&g->slot[i & (g->size-1)], LOAD(&a->slot[i & (a->size-1)], RELAXED), RELAXED);
+		}
+		STORE(&this->array, g, RELEASE);
+		a = g;
+	}
+	STORE(&a->slot[b & (a->size-1)], item, RELAXED);
+	atomic_thread_fence(RELEASE);
+	STORE(&this->bottom, b+1, RELAXED);
+
+	return STATUS_SUCCESS;
+}
+
+// Owner side: NULL if empty
+static inline void*
+deque_take (Deque *const this)
+{
+	signed long long const b = LOAD(&this->bottom, RELAXED) - 1;
+	struct DequeArray *const a = LOAD(&this->array, RELAXED);
+	STORE(&this->bottom, b, RELAXED);
+	atomic_thread_fence(SEQ_CST);
+	signed long long t = LOAD(&this->top, RELAXED);
+
+	void* item = NULL;
+	if (t <= b) {
+		item = LOAD(&a->slot[b & (a->size-1)], RELAXED);
+		if (t == b) { // last item: race with thieves
+			if (!CAS(&this->top, &t, t+1, SEQ_CST, RELAXED)) {
+				item = NULL;
+			}
+			STORE(&this->bottom, b+1, RELAXED);
+		}
+	} else {
+		STORE(&this->bottom, b+1, RELAXED);
+	}
+	return item;
+}
+
+// Thief side: NULL if empty, DEQUE_ABORT if another thread won the race
+static inline void*
+deque_steal (Deque *const this)
+{
+	signed long long t = LOAD(&this->top, ACQUIRE);
+	atomic_thread_fence(SEQ_CST);
+	signed long long const b = LOAD(&this->bottom, ACQUIRE);
+
+	if (t >= b) {
+		return NULL;
+	}
+	struct DequeArray *const a = LOAD(&this->array, ACQUIRE);
+	void *const item = LOAD(&a->slot[t & (a->size-1)], RELAXED);
+	if (!CAS(&this->top, &t, t+1, SEQ_CST, RELAXED)) {
+		return DEQUE_ABORT;
+	}
+	return item;
+}
+
+#endif // vim:ai:sw=4:ts=4:syntax=cpp
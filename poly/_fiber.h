@@ -0,0 +1,263 @@
+#ifndef POLY_FIBER_CORE_H
+#define POLY_FIBER_CORE_H
+
+#ifndef POLY_H
+#include "POLY.h"
+#endif
+#include "atomics.h"
+#include "thread.h"
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+//#include <stdlib.h>
+extern void  free(void*);
+extern void* malloc(size_t);
+//#include <string.h>
+extern void* memcpy(void*, void const*, size_t);
+
+/*
+ * Fiber runtime core: fibers, the scheduler run queue, context switches and
+ * the parking lot used by the futex backend (see `poly/fiber.h` for the
+ * public interface). It depends only on raw C11 threads and atomics, because
+ * the monitor layer is built on top of it.
+ *
+ * A fiber gives up its worker by switching to the worker context, which then
+ * completes the action left in `after` (requeue, unlock, reclaim): the fiber
+ * context is always saved before any other thread can resume it.
+ */
+
+////////////////////////////////////////////////////////////////////////
+// Fiber core interface
+////////////////////////////////////////////////////////////////////////
+
+typedef struct Fiber {
+	struct Fiber*      next;      // run queue or parking lot link
+	struct Scheduler*  scheduler;
+	atomic(unsigned)*  parked;    // futex word the fiber sleeps on
+	ucontext_t         context;
+	char*              mapping;   // stack mapping, guard page first
+	size_t             mapped;
+	unsigned           thread_id; // saved `Thread_ID`
+#ifdef POLY_PROFILE
+	unsigned long long profile_waited; // saved `PROFILE_WAITED_`
+#endif
+	int              (*main)(void*);
+	_Alignas(max_align_t) char data[];
+} Fiber;
+
+typedef struct Scheduler {
+	mtx_t       lock;
+	cnd_t       idle;     // workers without fibers to run
+	cnd_t       quiet;    // scheduler_wait callers
+	Fiber*      head;     // run queue
+	Fiber*      tail;
+	unsigned    live;     // # of fibers not yet finished
+	unsigned    sleeping; // # of workers in `idle`
+	bool        stopping;
+	unsigned    size;
+	size_t      stack;    // usable stack bytes per fiber
+	thrd_t*     threads;
+} Scheduler;
+
+static Fiber* fiber_current(void);
+static void   fiber_yield(void);
+
+// private: used by the futex backend
+static int      fiber_futex_wait_(atomic(unsigned)* word, unsigned expected, Clock deadline);
+static unsigned fiber_futex_wake_(atomic(unsigned)* word, unsigned n);
+
+////////////////////////////////////////////////////////////////////////
+// Fiber core implementation
+////////////////////////////////////////////////////////////////////////
+
+// Worker thread state
+struct FiberWorker_ {
+	Scheduler*  scheduler;
+	Fiber*      current;
+	ucontext_t  context;
+	unsigned    after;      // action to complete after a switch
+	void*       after_arg;
+};
+
+enum {
+	FIBER_AFTER_NONE_,
+	FIBER_AFTER_YIELD_,     // requeue the fiber
+	FIBER_AFTER_PARK_,      // release the parking lot bucket
+	FIBER_AFTER_EXIT_,      // reclaim the fiber
+};
+
+static _Thread_local struct FiberWorker_* FIBER_WORKER_ = NULL;
+
+// Not inlined: a fiber may resume on another thread, so the thread local
+// address must not be kept across a switch
+static __attribute__((noinline)) struct FiberWorker_*
+fiber_worker_ (void)
+{
+	return FIBER_WORKER_;
+}
+
+static inline Fiber*
+fiber_current (void)
+{
+	struct FiberWorker_ *const w = fiber_worker_();
+	return (w == NULL) ? NULL : w->current;
+}
+
+// Switch from the running fiber to its worker
+static inline void
+fiber_switch_ (unsigned after, void* arg)
+{
+	struct FiberWorker_ *const w = fiber_worker_();
+	Fiber *const self = w->current;
+
+	w->after = after;
+	w->after_arg = arg;
+	swapcontext(&self->context, &w->context);
+}
+
+////////////////////////////////////////////////////////////////////////
+
+// Make a fiber runnable
+static inline void
+fiber_ready_ (Fiber* fiber)
+{
+	Scheduler *const this = fiber->scheduler;
+
+	fiber->next = NULL;
+	mtx_lock(&this->lock);
+	if (this->tail == NULL) {
+		this->head = fiber;
+	} else {
+		this->tail->next = fiber;
+	}
+	this->tail = fiber;
+	if (this->sleeping > 0) {
+		cnd_signal(&this->idle);
+	}
+	mtx_unlock(&this->lock);
+}
+
+static inline void
+fiber_yield (void)
+{
+	if (fiber_current() == NULL) {
+		thread_yield();
+		return;
+	}
+	fiber_switch_(FIBER_AFTER_YIELD_, NULL);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Parking lot: fibers sleeping on futex words
+////////////////////////////////////////////////////////////////////////
+
+enum { FIBER_BUCKETS_=64 };
+
+static struct FiberBucket_ {
+	atomic_flag       lock;
+	atomic(unsigned)  count; // # of parked fibers
+	Fiber*            head;
+} FIBER_LOT_[FIBER_BUCKETS_];
+
+static ALWAYS inline struct FiberBucket_*
+fiber_bucket_ (atomic(unsigned)* word)
+{
+	uintptr_t const h = ((uintptr_t)word >> 2) * 2654435761u;
+	return &FIBER_LOT_[(h >> 8) % FIBER_BUCKETS_];
+}
+
+static ALWAYS inline void
+fiber_bucket_lock_ (struct FiberBucket_* bucket)
+{
+	while (TAS(&bucket->lock, ACQUIRE)) {
+		cpu_relax();
+	}
+}
+
+static ALWAYS inline void
+fiber_bucket_unlock_ (struct FiberBucket_* bucket)
+{
+	CLEAR(&bucket->lock, RELEASE);
+}
+
+/*
+ * Same contract as `futex_wait`. Waits with a deadline poll: the fiber
+ * yields once and reports a spurious wakeup, and the caller loop retries.
+ */
+static int
+fiber_futex_wait_ (atomic(unsigned)* word, unsigned expected, Clock deadline)
+{
+	if (deadline >= 0) {
+		if (now() >= deadline) {
+			return STATUS_TIMEDOUT;
+		}
+		fiber_yield();
+		return STATUS_SUCCESS;
+	}
+
+	Fiber *const self = fiber_current();
+	struct FiberBucket_ *const bucket = fiber_bucket_(word);
+
+	fiber_bucket_lock_(bucket);
+	reg_add(&bucket->count, 1, RELAXED);
+	atomic_thread_fence(SEQ_CST);
+	if (LOAD(&word[0], RELAXED) != expected) {
+		reg_sub(&bucket->count, 1, RELAXED);
+		fiber_bucket_unlock_(bucket);
+		return STATUS_SUCCESS;
+	}
+	Fiber** link = &bucket->head; // append, to wake in arrival order
+	while (*link != NULL) {
+		link = &(*link)->next;
+	}
+	self->parked = word;
+	self->next = NULL;
+	*link = self;
+	fiber_switch_(FIBER_AFTER_PARK_, bucket);
+
+	return STATUS_SUCCESS;
+}
+
+// Wake up to `n` fibers parked on `word`; returns how many
+static unsigned
+fiber_futex_wake_ (atomic(unsigned)* word, unsigned n)
+{
+	struct FiberBucket_ *const bucket = fiber_bucket_(word);
+
+	atomic_thread_fence(SEQ_CST);
+	if (LOAD(&bucket->count, RELAXED) == 0) {
+		return 0;
+	}
+
+	Fiber* woken = NULL;
+	Fiber** last = &woken;
+	unsigned k = 0;
+	fiber_bucket_lock_(bucket);
+	for (Fiber** link = &bucket->head; *link != NULL && k < n; ) {
+		Fiber *const fiber = *link;
+		if (fiber->parked != word) {
+			link = &fiber->next;
+			continue;
+		}
+		*link = fiber->next;
+		fiber->parked = NULL;
+		fiber->next = NULL;
+		*last = fiber;
+		last = &fiber->next;
+		++k;
+	}
+	reg_sub(&bucket->count, k, RELAXED);
+	fiber_bucket_unlock_(bucket);
+
+	while (woken != NULL) {
+		Fiber *const fiber = woken;
+		woken = fiber->next;
+		fiber_ready_(fiber);
+	}
+	return k;
+}
+
+#endif // vim:ai:sw=4:ts=4:syntax=cpp
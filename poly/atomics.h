@@ -139,6 +139,19 @@ enum {
 // void atomic_thread_fence(memory_order order);
 // void atomic_signal_fence(memory_order order);
 
+////////////////////////////////////////////////////////////////////////
+// Spin hints
+////////////////////////////////////////////////////////////////////////
+
+// tell the CPU we are in a spin-wait loop
+#if defined(__x86_64__) || defined(__i386__)
+#   define cpu_relax()  __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#   define cpu_relax()  __asm__ __volatile__ ("yield" ::: "memory")
+#else
+#   define cpu_relax()  atomic_signal_fence(memory_order_seq_cst)
+#endif
+
 ////////////////////////////////////////////////////////////////////////
 // Idioms
 ////////////////////////////////////////////////////////////////////////
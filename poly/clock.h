@@ -0,0 +1,116 @@
+#ifndef POLY_CLOCK_H
+#define POLY_CLOCK_H
+
+#ifndef POLY_H
+#include "POLY.h"
+#endif
+
+/*
+ * Timestamps for instrumentation. `now()` (in POLY.h) is the monotonic base
+ * of all deadlines, but costs a vDSO call; `timestamp()` reads the CPU time
+ * stamp counter when it is invariant (constant rate, not stopped in sleep
+ * states), and falls back to `now()` elsewhere. Tick differences are
+ * converted to nanoseconds with `ticks2ns`, calibrated against
+ * CLOCK_MONOTONIC on first use (a busy wait of about
+ * `POLY_CLOCK_CALIBRATION` nanoseconds).
+ *
+ * Ticks are only meaningful as differences, and only between threads if
+ * the counters of all cores are synchronized (as in any invariant TSC
+ * system booted by a sane firmware).
+ */
+
+////////////////////////////////////////////////////////////////////////
+// Clock interface
+////////////////////////////////////////////////////////////////////////
+
+#ifndef POLY_CLOCK_CALIBRATION
+#define POLY_CLOCK_CALIBRATION  ms2ns(2)
+#endif
+
+typedef unsigned long long Ticks;
+
+static Ticks    timestamp(void);
+static Clock    ticks2ns(Ticks ticks);
+static Clock    clock_utc(void);
+
+/*
+ *  Ticks t0 = timestamp();
+ *  ...
+ *  Clock elapsed = ticks2ns(timestamp() - t0);
+ *
+ *  Clock today = clock_utc(); // calendar time, not for deadlines
+ */
+
+////////////////////////////////////////////////////////////////////////
+// Clock implementation
+////////////////////////////////////////////////////////////////////////
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+// private: calibration, set once (ns = ticks * mult >> 32)
+static struct {
+	once_flag           once;
+	bool                tsc;
+	unsigned long long  mult;
+} CLOCK_ = { .once=ONCE_FLAG_INIT, .tsc=false, .mult=1ull<<32 };
+
+static ALWAYS inline Ticks
+clock_read_ (void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	if (CLOCK_.tsc) {
+		return __rdtsc();
+	}
+#endif
+	return now();
+}
+
+static void
+clock_calibrate_ (void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned eax, ebx, ecx, edx;
+	if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u<<8))) {
+		Clock const c0 = now();
+		Ticks const t0 = __rdtsc();
+		Clock c1;
+		while ((c1=now()) - c0 < POLY_CLOCK_CALIBRATION) {
+			;
+		}
+		Ticks const t1 = __rdtsc();
+		if (t1 > t0) {
+			CLOCK_.mult = ((unsigned long long)(c1 - c0) << 32) / (t1 - t0);
+			CLOCK_.tsc  = true;
+		}
+	}
+#endif
+}
+
+static inline Ticks
+timestamp (void)
+{
+	call_once(&CLOCK_.once, clock_calibrate_);
+	return clock_read_();
+}
+
+// Convert a difference of `timestamp()` values
+static inline Clock
+ticks2ns (Ticks ticks)
+{
+	call_once(&CLOCK_.once, clock_calibrate_);
+	return (Clock)(((unsigned __int128)ticks * CLOCK_.mult) >> 32);
+}
+
+// TIME_UTC based absolute calendar time point in nanoseconds
+static inline Clock
+clock_utc (void)
+{
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return s2ns(ts.tv_sec) + ts.tv_nsec;
+}
+
+#endif // vim:ai:sw=4:ts=4:syntax=cpp
@@ -0,0 +1,399 @@
+#ifndef POLY_EXECUTOR_H
+#define POLY_EXECUTOR_H
+
+#ifndef POLY_H
+#include "POLY.h"
+#endif
+#include "atomics.h"
+#include "thread.h"
+#include "monitor/lock.h"
+#include "monitor/condition.h"
+#include "_deque.h"
+
+#include <unistd.h> // sysconf
+
+//#include <stdlib.h>
+extern void  free(void*);
+extern void* calloc(size_t, size_t);
+extern void* malloc(size_t);
+//#include <string.h>
+extern void* memcpy(void*, void const*, size_t);
+
+/*
+ * A fixed set of worker threads running submitted jobs. Each worker owns a
+ * Chase-Lev deque: jobs submitted from a worker go to its own deque, jobs
+ * submitted from other threads go to a shared injection list, and idle
+ * workers steal from random victims before sleeping.
+ *
+ * Jobs are the usual `int T(void*)` thread bodies with their `struct T`
+ * argument blocks, which are copied with the job. A job that blocks holds
+ * its worker while blocked.
+ */
+
+////////////////////////////////////////////////////////////////////////
+// Executor interface
+////////////////////////////////////////////////////////////////////////
+
+typedef struct Job {
+	struct Job*       next;  // link in the injection list
+	int             (*main)(void*);
+	atomic(unsigned)* join;  // spawned: the spawner's counter (see `poly/forkjoin.h`)
+	_Alignas(max_align_t) char data[];
+} Job;
+
+typedef struct Worker {
+	CACHE_ALIGNED
+	Deque                 deque;
+	struct Executor*      executor;
+	Thread                thread;
+	unsigned              index;
+	unsigned              seed; // victim selection
+} Worker;
+
+typedef struct Executor {
+	Lock                  syncronized;
+	Condition             idle;     // sleeping workers
+	Condition             quiet;    // executor_wait callers
+	Job*                  head;     // injection list
+	Job*                  tail;
+	atomic(unsigned)      pending;  // # of queued jobs
+	atomic(unsigned)      active;   // # of queued or running jobs
+	atomic(unsigned)      sleeping; // # of workers in `idle`
+	atomic(unsigned)      hungry;   // # of workers looking for jobs or sleeping
+	atomic(bool)          stopping;
+	unsigned              size;
+	Worker*               workers;
+} Executor;
+
+static int      executor_init(Executor *const this, unsigned workers);
+static void     executor_destroy(Executor *const this);
+static unsigned executor_size(Executor const*const this);
+static int      executor_submit(Executor *const this, int main(void*), void const* data, size_t size);
+static int      executor_wait(Executor *const this);
+
+/*
+ *  struct T {
+ *      THREAD_TYPE
+ *      ...
+ *  };
+ *
+ *  Executor e;
+ *  catch (executor_init(&e, 0)); // one worker per core
+ *  submit(&e, T, .a=1, .b=2);
+ *  ...
+ *  catch (executor_wait(&e));
+ *  executor_destroy(&e);
+ */
+#define submit(E,T,...)                                                    \
+do {                                                                       \
+    struct T data_ = {__VA_ARGS__};                                        \
+    int const err_ = executor_submit((E), T, &data_, sizeof(data_));       \
+    if (err_ != STATUS_SUCCESS) panic("cannot submit job");                \
+} while (0)
+
+#define submit_filter(E,T,I,O,...) \
+    submit(E, T, .input=(I), .output=(O) __VA_OPT__(,)__VA_ARGS__)
+
+////////////////////////////////////////////////////////////////////////
+// Executor implementation
+////////////////////////////////////////////////////////////////////////
+
+// The worker running in the current thread, if any
+static _Thread_local Worker* EXECUTOR_WORKER_ = NULL;
+
+enum { EXECUTOR_DEQUE_SIZE=256, EXECUTOR_STEAL_ROUNDS=4 };
+
+static ALWAYS inline unsigned
+executor_size (Executor const*const this)
+{
+	return this->size;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+// Pop from the injection list (NULL if empty)
+static inline Job*
+executor_inject_pop_ (Executor *const this)
+{
+	if (LOAD(&this->pending, RELAXED) == 0) {
+		return NULL;
+	}
+	lock_acquire(&this->syncronized);
+	Job *const job = this->head;
+	if (job != NULL) {
+		this->head = job->next;
+		if (this->head == NULL) {
+			this->tail = NULL;
+		}
+	}
+	lock_release(&this->syncronized);
+	return job;
+}
+
+// Own deque, then injection list, then steal from the other workers
+static inline Job*
+executor_find_ (Worker *const self)
+{
+	Executor *const this = self->executor;
+	Job* job;
+
+	if ((job=deque_take(&self->deque)) != NULL) {
+		return job;
+	}
+	if ((job=executor_inject_pop_(this)) != NULL) {
+		return job;
+	}
+	for (unsigned round = 0; round < EXECUTOR_STEAL_ROUNDS; ++round) {
+		bool aborted = false;
+		self->seed ^= self->seed << 13; // xorshift
+		self->seed ^= self->seed >> 17;
+		self->seed ^= self->seed << 5;
+		for (unsigned i = 0; i < this->size; ++i) {
+			Worker *const victim = &this->workers[(self->seed + i) % this->size];
+			if (victim == self) { continue; }
+			job = deque_steal(&victim->deque);
+			if (job == DEQUE_ABORT) {
+				aborted = true;
+			} else if (job != NULL) {
+				return job;
+			}
+		}
+		if (!aborted) { break; }
+		cpu_relax();
+	}
+	return NULL;
+}
+
+// Nothing left to do: stopping, and all jobs have finished
+static ALWAYS inline bool
+executor_done_ (Executor const*const this)
+{
+	return LOAD(&this->stopping, ACQUIRE) && LOAD(&this->active, ACQUIRE) == 0;
+}
+
+// Sleep until some job is queued or the executor is done
+static inline void
+executor_sleep_ (Executor *const this)
+{
+	lock_acquire(&this->syncronized);
+	reg_add(&this->sleeping, 1, RELAXED);
+	atomic_thread_fence(SEQ_CST);
+	while (LOAD(&this->pending, RELAXED) == 0 && !executor_done_(this)) {
+		condition_wait(&this->idle, &this->syncronized);
+	}
+	reg_sub(&this->sleeping, 1, RELAXED);
+	lock_release(&this->syncronized);
+}
+
+static inline void
+executor_run_ (Executor *const this, Job* job)
+{
+	reg_sub(&this->pending, 1, RELAXED);
+	job->main(job->data);
+	if (job->join != NULL) { // spawned: the job lives in the spawner frame
+		reg_sub(job->join, 1, RELEASE);
+		return;
+	}
+	free(job);
+	if (reg_sub(&this->active, 1, ACQ_REL) == 1) { // last active job
+		lock_acquire(&this->syncronized);
+		condition_broadcast(&this->quiet);
+		if (LOAD(&this->stopping, RELAXED)) {
+			condition_broadcast(&this->idle);
+		}
+		lock_release(&this->syncronized);
+	}
+}
+
+static int
+executor_worker_ (void* data)
+{
+	Worker *const self = data;
+	Executor *const this = self->executor;
+	EXECUTOR_WORKER_ = self;
+	THREAD_POOLED_ = true;
+
+	reg_add(&this->hungry, 1, RELAXED);
+	for (;;) {
+		Job *const job = executor_find_(self);
+		if (job != NULL) {
+			reg_sub(&this->hungry, 1, RELAXED);
+			executor_run_(this, job);
+			reg_add(&this->hungry, 1, RELAXED);
+			continue;
+		}
+		if (executor_done_(this)) {
+			break;
+		}
+		executor_sleep_(this);
+	}
+	return STATUS_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+// `workers` == 0 means one worker per online core
+static int
+executor_init (Executor *const this, unsigned workers)
+{
+	int err;
+
+	if (workers == 0) {
+		long const n = sysconf(_SC_NPROCESSORS_ONLN);
+		workers = (n > 0) ? (unsigned)n : 1;
+	}
+	this->size = workers;
+	this->head = this->tail = NULL;
+	STORE(&this->pending, 0, RELAXED);
+	STORE(&this->active, 0, RELAXED);
+	STORE(&this->sleeping, 0, RELAXED);
+	STORE(&this->hungry, 0, RELAXED);
+	STORE(&this->stopping, false, RELAXED);
+
+	if ((this->workers = calloc(workers, sizeof(Worker))) == NULL) {
+		return STATUS_NOMEM;
+	}
+	catch (lock_init(&this->syncronized));
+	if ((err=condition_init(&this->idle)) != STATUS_SUCCESS) {
+		lock_destroy(&this->syncronized);
+		goto onerror;
+	}
+	if ((err=condition_init(&this->quiet)) != STATUS_SUCCESS) {
+		condition_destroy(&this->idle);
+		lock_destroy(&this->syncronized);
+		goto onerror;
+	}
+
+	unsigned i;
+	for (i = 0; i < workers; ++i) {
+		Worker *const w = &this->workers[i];
+		w->executor = this;
+		w->index = i;
+		w->seed = 2463534242u + i;
+		if ((err=deque_init(&w->deque, EXECUTOR_DEQUE_SIZE)) != STATUS_SUCCESS) {
+			break;
+		}
+	}
+	if (err != STATUS_SUCCESS) {
+		while (i-- > 0) { deque_destroy(&this->workers[i].deque); }
+		goto onerror_sync;
+	}
+	for (i = 0; i < workers; ++i) {
+		Worker *const w = &this->workers[i];
+		if ((err=thread_create(&w->thread, executor_worker_, w)) != STATUS_SUCCESS) {
+			break;
+		}
+	}
+	if (err != STATUS_SUCCESS) { // stop the started workers
+		lock_acquire(&this->syncronized);
+		STORE(&this->stopping, true, RELEASE);
+		condition_broadcast(&this->idle);
+		lock_release(&this->syncronized);
+		while (i-- > 0) { thread_join(this->workers[i].thread, NULL); }
+		for (i = 0; i < workers; ++i) { deque_destroy(&this->workers[i].deque); }
+		goto onerror_sync;
+	}
+
+	return STATUS_SUCCESS;
+onerror_sync:
+	condition_destroy(&this->quiet);
+	condition_destroy(&this->idle);
+	lock_destroy(&this->syncronized);
+onerror:
+	free(this->workers);
+	return err;
+}
+
+// Run the queued jobs, then stop and join the workers
+static void
+executor_destroy (Executor *const this)
+{
+	assert(EXECUTOR_WORKER_ == NULL || EXECUTOR_WORKER_->executor != this);
+
+	lock_acquire(&this->syncronized);
+	STORE(&this->stopping, true, RELEASE);
+	condition_broadcast(&this->idle);
+	lock_release(&this->syncronized);
+
+	for (unsigned i = 0; i < this->size; ++i) {
+		thread_join(this->workers[i].thread, NULL);
+	}
+	for (unsigned i = 0; i < this->size; ++i) {
+		deque_destroy(&this->workers[i].deque);
+	}
+	condition_destroy(&this->quiet);
+	condition_destroy(&this->idle);
+	lock_destroy(&this->syncronized);
+	free(this->workers);
+	this->workers = NULL;
+}
+
+// Queue `job`: on the own deque from a worker, else on the injection list
+static inline void
+executor_push_ (Executor *const this, Job* job)
+{
+	reg_add(&this->pending, 1, RELAXED);
+
+	Worker *const self = EXECUTOR_WORKER_;
+	if (self != NULL && self->executor == this && deque_push(&self->deque, job) == STATUS_SUCCESS) {
+		// pushed to the own deque
+	} else {
+		lock_acquire(&this->syncronized);
+		if (this->tail == NULL) {
+			this->head = job;
+		} else {
+			this->tail->next = job;
+		}
+		this->tail = job;
+		lock_release(&this->syncronized);
+	}
+
+	// wake a sleeping worker (see `executor_sleep_`)
+	atomic_thread_fence(SEQ_CST);
+	if (LOAD(&this->sleeping, RELAXED) != 0) {
+		lock_acquire(&this->syncronized);
+		condition_signal(&this->idle);
+		lock_release(&this->syncronized);
+	}
+}
+
+// Copy `data` into a new job, and queue it
+static int
+executor_submit (Executor *const this, int main(void*), void const* data, size_t size)
+{
+	assert(!LOAD(&this->stopping, RELAXED) || EXECUTOR_WORKER_ != NULL);
+
+	Job *const job = malloc(sizeof(Job) + size);
+	if (job == NULL) {
+		return STATUS_NOMEM;
+	}
+	job->next = NULL;
+	job->main = main;
+	job->join = NULL;
+	memcpy(job->data, data, size);
+
+	reg_add(&this->active, 1, RELAXED);
+	executor_push_(this, job);
+
+	return STATUS_SUCCESS;
+}
+
+// Wait until all submitted jobs have finished (not from a worker)
+static int
+executor_wait (Executor *const this)
+{
+	assert(EXECUTOR_WORKER_ == NULL || EXECUTOR_WORKER_->executor != this);
+	int err = STATUS_SUCCESS;
+
+	lock_acquire(&this->syncronized);
+	while (LOAD(&this->active, ACQUIRE) != 0) {
+		if ((err=condition_wait(&this->quiet, &this->syncronized)) != STATUS_SUCCESS) {
+			break;
+		}
+	}
+	lock_release(&this->syncronized);
+
+	return err;
+}
+
+#endif // vim:ai:sw=4:ts=4:syntax=cpp
@@ -0,0 +1,285 @@
+#ifndef POLY_FIBER_H
+#define POLY_FIBER_H
+
+#ifndef POLY_H
+#include "POLY.h"
+#endif
+#ifndef POLY_FIBERS
+#error Define POLY_FIBERS, before including any POLY header, to use fibers
+#endif
+#include "atomics.h"
+#include "thread.h"
+#include "_fiber.h"
+#ifdef POLY_PROFILE
+#include "monitor/profile.h"
+#endif
+
+/*
+ * Fibers: thread bodies (`THREAD_TYPE`/`THREAD_BODY`) run as user space
+ * threads on a small pool of OS threads, each with a small stack protected
+ * by a guard page.
+ *
+ * With `POLY_FIBERS` defined the monitor layer uses the futex backend, and
+ * futex waits in a fiber park the fiber instead of the OS thread: locks,
+ * conditions, notices and so channels, ports and entries yield to the
+ * scheduler when they block. Timed waits in fibers poll, yielding between
+ * checks.
+ */
+
+////////////////////////////////////////////////////////////////////////
+// Scheduler interface
+////////////////////////////////////////////////////////////////////////
+
+#ifndef POLY_FIBER_STACK
+#define POLY_FIBER_STACK    (64*1024) // default usable stack bytes
+#endif
+
+static int  scheduler_init(Scheduler *const this, unsigned threads, size_t stack);
+static void scheduler_destroy(Scheduler *const this);
+static int  scheduler_spawn(Scheduler *const this, int main(void*), void const* data, size_t size);
+static int  scheduler_wait(Scheduler *const this);
+
+// Fiber* fiber_current(void);  NULL out of fibers
+// void   fiber_yield(void);    thread_yield out of fibers
+
+/*
+ *  Scheduler s;
+ *  catch (scheduler_init(&s, 0, 0)); // one OS thread per core, default stacks
+ *  run_fiber(&s, T, .a=1, .b=2);
+ *  ...
+ *  catch (scheduler_wait(&s));
+ *  scheduler_destroy(&s);
+ */
+#define run_fiber(S,T,...)                                                 \
+do {                                                                       \
+    struct T data_ = {__VA_ARGS__};                                        \
+    int const err_ = scheduler_spawn((S), T, &data_, sizeof(data_));       \
+    if (err_ != STATUS_SUCCESS) panic("cannot start fiber");               \
+} while (0)
+
+#define run_fiber_filter(S,T,I,O,...) \
+    run_fiber(S, T, .input=(I), .output=(O) __VA_OPT__(,)__VA_ARGS__)
+
+////////////////////////////////////////////////////////////////////////
+// Scheduler implementation
+////////////////////////////////////////////////////////////////////////
+
+// First function run by every fiber
+static void
+scheduler_trampoline_ (void)
+{
+	Fiber *const self = fiber_current();
+	self->main(self->data);
+	fiber_switch_(FIBER_AFTER_EXIT_, NULL);
+	assert(internal_error); // never resumed
+}
+
+static inline void
+scheduler_reclaim_ (Scheduler *const this, Fiber* fiber)
+{
+	munmap(fiber->mapping, fiber->mapped);
+	free(fiber);
+
+	mtx_lock(&this->lock);
+	if (--this->live == 0) {
+		cnd_broadcast(&this->quiet);
+		if (this->stopping) {
+			cnd_broadcast(&this->idle);
+		}
+	}
+	mtx_unlock(&this->lock);
+}
+
+static int
+scheduler_worker_ (void* data)
+{
+	Scheduler *const this = data;
+	struct FiberWorker_ worker = { .scheduler = this };
+	FIBER_WORKER_ = &worker;
+	THREAD_POOLED_ = true;
+
+	for (;;) {
+		mtx_lock(&this->lock);
+		while (this->head == NULL && !(this->stopping && this->live == 0)) {
+			++this->sleeping;
+			cnd_wait(&this->idle, &this->lock);
+			--this->sleeping;
+		}
+		Fiber *const fiber = this->head;
+		if (fiber != NULL) {
+			this->head = fiber->next;
+			if (this->head == NULL) {
+				this->tail = NULL;
+			}
+		}
+		mtx_unlock(&this->lock);
+		if (fiber == NULL) {
+			break;
+		}
+
+		worker.current = fiber;
+		Thread_ID = fiber->thread_id;
+#ifdef POLY_PROFILE
+		PROFILE_WAITED_ = fiber->profile_waited;
+#endif
+		swapcontext(&worker.context, &fiber->context);
+		fiber->thread_id = Thread_ID;
+#ifdef POLY_PROFILE
+		fiber->profile_waited = PROFILE_WAITED_;
+#endif
+		worker.current = NULL;
+
+		switch (worker.after) {
+			case FIBER_AFTER_YIELD_:
+				fiber_ready_(fiber);
+				break;
+			case FIBER_AFTER_PARK_:
+				fiber_bucket_unlock_(worker.after_arg);
+				break;
+			case FIBER_AFTER_EXIT_:
+				scheduler_reclaim_(this, fiber);
+				break;
+			default:
+				assert(internal_error);
+		}
+		worker.after = FIBER_AFTER_NONE_;
+	}
+	FIBER_WORKER_ = NULL;
+
+	return STATUS_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+// `threads` == 0 means one per online core; `stack` == 0 means the default
+static int
+scheduler_init (Scheduler *const this, unsigned threads, size_t stack)
+{
+	int err;
+
+	if (threads == 0) {
+		long const n = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (n > 0) ? (unsigned)n : 1;
+	}
+	this->size = threads;
+	this->stack = (stack == 0) ? POLY_FIBER_STACK : stack;
+	this->head = this->tail = NULL;
+	this->live = this->sleeping = 0;
+	this->stopping = false;
+
+	if ((this->threads = malloc(threads*sizeof(thrd_t))) == NULL) {
+		return STATUS_NOMEM;
+	}
+	catch (mtx_init(&this->lock, mtx_plain));
+	if ((err=cnd_init(&this->idle)) != STATUS_SUCCESS) {
+		mtx_destroy(&this->lock);
+		goto onerror;
+	}
+	if ((err=cnd_init(&this->quiet)) != STATUS_SUCCESS) {
+		cnd_destroy(&this->idle);
+		mtx_destroy(&this->lock);
+		goto onerror;
+	}
+
+	for (unsigned i = 0; i < threads; ++i) {
+		if ((err=thread_create(&this->threads[i], scheduler_worker_, this)) != STATUS_SUCCESS) {
+			this->size = i;
+			scheduler_destroy(this);
+			return err;
+		}
+	}
+
+	return STATUS_SUCCESS;
+onerror:
+	free(this->threads);
+	return err;
+}
+
+// Wait until all fibers have finished, then stop and join the OS threads
+static void
+scheduler_destroy (Scheduler *const this)
+{
+	assert(fiber_current() == NULL);
+
+	mtx_lock(&this->lock);
+	this->stopping = true;
+	cnd_broadcast(&this->idle);
+	mtx_unlock(&this->lock);
+
+	for (unsigned i = 0; i < this->size; ++i) {
+		thread_join(this->threads[i], NULL);
+	}
+	cnd_destroy(&this->quiet);
+	cnd_destroy(&this->idle);
+	mtx_destroy(&this->lock);
+	free(this->threads);
+	this->threads = NULL;
+}
+
+// Copy `data` into a new fiber, and make it runnable
+static int
+scheduler_spawn (Scheduler *const this, int main(void*), void const* data, size_t size)
+{
+	size_t const page = sysconf(_SC_PAGESIZE);
+	size_t const usable = (this->stack + page-1) & ~(page-1);
+
+	Fiber *const fiber = malloc(sizeof(Fiber) + size);
+	if (fiber == NULL) {
+		return STATUS_NOMEM;
+	}
+	// executable: nested function trampolines live on the stack
+	fiber->mapped = usable + page;
+	fiber->mapping = mmap(NULL, fiber->mapped, PROT_READ|PROT_WRITE|PROT_EXEC,
+	                      MAP_PRIVATE|MAP_ANONYMOUS|MAP_STACK, -1, 0);
+	if (fiber->mapping == MAP_FAILED) {
+		free(fiber);
+		return STATUS_NOMEM;
+	}
+	if (mprotect(fiber->mapping, page, PROT_NONE) != 0) { // guard page
+		munmap(fiber->mapping, fiber->mapped);
+		free(fiber);
+		return STATUS_ERROR;
+	}
+
+	fiber->scheduler = this;
+	fiber->parked = NULL;
+	fiber->thread_id = 0;
+#ifdef POLY_PROFILE
+	fiber->profile_waited = 0;
+#endif
+	fiber->main = main;
+	memcpy(fiber->data, data, size);
+
+	getcontext(&fiber->context);
+	fiber->context.uc_stack.ss_sp = fiber->mapping + page;
+	fiber->context.uc_stack.ss_size = usable;
+	fiber->context.uc_link = NULL;
+	makecontext(&fiber->context, scheduler_trampoline_, 0);
+
+	mtx_lock(&this->lock);
+	++this->live;
+	mtx_unlock(&this->lock);
+	fiber_ready_(fiber);
+
+	return STATUS_SUCCESS;
+}
+
+// Wait until all fibers have finished (not from a fiber)
+static int
+scheduler_wait (Scheduler *const this)
+{
+	assert(fiber_current() == NULL);
+	int err = STATUS_SUCCESS;
+
+	mtx_lock(&this->lock);
+	while (this->live != 0) {
+		if ((err=cnd_wait(&this->quiet, &this->lock)) != STATUS_SUCCESS) {
+			break;
+		}
+	}
+	mtx_unlock(&this->lock);
+
+	return err;
+}
+
+#endif // vim:ai:sw=4:ts=4:syntax=cpp
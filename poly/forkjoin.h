@@ -0,0 +1,129 @@
+#ifndef POLY_FORKJOIN_H
+#define POLY_FORKJOIN_H
+
+#ifndef POLY_H
+#include "POLY.h"
+#endif
+#include "atomics.h"
+#include "executor.h"
+
+#include <alloca.h>
+
+/*
+ * Cilk style fork-join on executor workers. A job spawns calls, which are
+ * pushed onto the worker deque for idle workers to steal (child stealing),
+ * and then syncs. While syncing the worker runs its own unstolen calls and
+ * steals other jobs instead of blocking.
+ *
+ * A spawned call is a function `int T(void*)` taking a `struct T` argument
+ * block, as thread bodies do, but without THREAD_TYPE/THREAD_BODY. The
+ * block is copied at the spawn into the spawner stack frame: no memory
+ * allocation. That storage is released when the spawning function
+ * returns, so functions spawning in long loops should sync and return
+ * between batches. Out of workers `spawn` just calls the body, and so it
+ * does while no worker is hungry (all are running jobs): there is nobody
+ * to steal the call, so queuing it would only pay for the deque and the
+ * wakeup check. Hungry workers are counted by the executor.
+ */
+
+////////////////////////////////////////////////////////////////////////
+// Fork-join interface
+////////////////////////////////////////////////////////////////////////
+
+typedef struct Join {
+	atomic(unsigned) count; // # of spawned calls not yet finished
+} Join;
+
+static void join_init(Join *const this);
+static void join_sync(Join *const this);
+
+/*
+ *  struct Fib {
+ *      long  n;
+ *      long* result;
+ *  };
+ *
+ *  int Fib(void* data) {
+ *      struct Fib const this = *(struct Fib*)data;
+ *      if (this.n < 2) { *this.result = this.n; return 0; }
+ *      long x, y;
+ *      Join j;
+ *      join_init(&j);
+ *      spawn(&j, Fib, .n=this.n-1, .result=&x);
+ *      spawn(&j, Fib, .n=this.n-2, .result=&y);
+ *      join_sync(&j);
+ *      *this.result = x + y;
+ *      return 0;
+ *  }
+ */
+#define spawn(J,T,...)                                                     \
+do {                                                                       \
+    Job *const job_ = alloca(sizeof(Job) + sizeof(struct T));              \
+    *(struct T*)job_->data = (struct T){__VA_ARGS__};                      \
+    join_spawn_((J), job_, T);                                             \
+} while (0)
+
+////////////////////////////////////////////////////////////////////////
+// Fork-join implementation
+////////////////////////////////////////////////////////////////////////
+
+enum { JOIN_SPIN=64 }; // failed steal rounds before yielding
+
+static ALWAYS inline void
+join_init (Join *const this)
+{
+	STORE(&this->count, 0, RELAXED);
+}
+
+// Queue `job` (living in the caller frame) on the worker deque
+static inline void
+join_spawn_ (Join *const this, Job* job, int main(void*))
+{
+	Worker *const self = EXECUTOR_WORKER_;
+	if (self == NULL || LOAD(&self->executor->hungry, RELAXED) == 0) { // serial
+		main(job->data);
+		return;
+	}
+
+	job->next = NULL;
+	job->main = main;
+	job->join = &this->count;
+	reg_add(&this->count, 1, RELAXED);
+	executor_push_(self->executor, job);
+}
+
+// Wait until all calls spawned on `this` have finished, running other jobs
+static inline void
+join_sync (Join *const this)
+{
+	Worker *const self = EXECUTOR_WORKER_;
+	unsigned idle = 0;
+	bool hungry = false; // counted by the executor while finding nothing
+
+	while (LOAD(&this->count, ACQUIRE) != 0) {
+		Job *const job = (self == NULL) ? NULL : executor_find_(self);
+		if (job != NULL) {
+			if (hungry) {
+				reg_sub(&self->executor->hungry, 1, RELAXED);
+				hungry = false;
+			}
+			executor_run_(self->executor, job);
+			idle = 0;
+			continue;
+		}
+		if (self != NULL && !hungry) { // waiting for stolen calls
+			reg_add(&self->executor->hungry, 1, RELAXED);
+			hungry = true;
+		}
+		if (++idle < JOIN_SPIN) {
+			cpu_relax();
+		} else {
+			thread_yield();
+		}
+	}
+	if (hungry) {
+		reg_sub(&self->executor->hungry, 1, RELAXED);
+	}
+}
+
+#endif // vim:ai:sw=4:ts=4:syntax=cpp
@@ -0,0 +1,303 @@
+#ifndef POLY_GRAPH_H
+#define POLY_GRAPH_H
+
+#ifndef POLY_H
+#include "POLY.h"
+#endif
+#include "atomics.h"
+#include "executor.h"
+#include "passing/future.h"
+
+//#include <stdlib.h>
+extern void  free(void*);
+extern void* malloc(size_t);
+extern void* realloc(void*, size_t);
+//#include <string.h>
+extern void* memcpy(void*, void const*, size_t);
+
+/*
+ * Dataflow graphs of tasks run on the workers of an executor. Each node
+ * keeps an atomic counter of the predecessors still to finish in the
+ * current run; the node finishing last pushes the successor to the worker
+ * deque. Graphs are built once and run any number of times.
+ *
+ * Tasks are `int T(void*)` functions with their `struct T` argument block,
+ * copied into the node; a task can update its block for the next runs.
+ */
+
+////////////////////////////////////////////////////////////////////////
+// Graph interface
+////////////////////////////////////////////////////////////////////////
+
+typedef struct GraphNode {
+	struct Graph*         graph;
+	Job*                  job;        // queued to run the node
+	int                 (*main)(void*);
+	unsigned              inputs;     // # of predecessors
+	atomic(unsigned)      pending;    // predecessors not finished in this run
+	unsigned              outputs;    // # of successors
+	unsigned              capacity;
+	struct GraphNode**    successors;
+	_Alignas(max_align_t) char data[];
+} GraphNode;
+
+typedef struct Graph {
+	Executor*             executor;
+	unsigned              size;
+	unsigned              capacity;
+	GraphNode**           nodes;
+	bool                  checked;    // acyclic since the last change
+	atomic(unsigned)      remaining;  // nodes not finished in this run
+	atomic(unsigned)      queued;     // jobs referenced by the executor
+	atomic(int)           status;     // first task error in this run
+	Future                done;
+} Graph;
+
+static int      graph_init(Graph *const this, Executor* executor);
+static void     graph_destroy(Graph *const this);
+static unsigned graph_size(Graph const*const this);
+static int      graph_add(Graph *const this, int main(void*), void const* data, size_t size, unsigned id[static 1]);
+static int      graph_edge(Graph *const this, unsigned from, unsigned to);
+static int      graph_run(Graph *const this);
+
+/*
+ *  Graph g;
+ *  catch (graph_init(&g, &executor));
+ *  unsigned a, b, c;
+ *  graph_task(&g, &a, Load, .file="a");
+ *  graph_task(&g, &b, Load, .file="b");
+ *  graph_task(&g, &c, Merge, .output=...);
+ *  catch (graph_edge(&g, a, c));
+ *  catch (graph_edge(&g, b, c));
+ *  catch (graph_run(&g));
+ *  catch (graph_run(&g)); // again
+ *  graph_destroy(&g);
+ */
+#define graph_task(G,ID,T,...)                                             \
+do {                                                                       \
+    struct T data_ = {__VA_ARGS__};                                        \
+    int const err_ = graph_add((G), T, &data_, sizeof(data_), (ID));       \
+    if (err_ != STATUS_SUCCESS) panic("cannot add graph task");            \
+} while (0)
+
+////////////////////////////////////////////////////////////////////////
+// Graph implementation
+////////////////////////////////////////////////////////////////////////
+
+static int
+graph_init (Graph *const this, Executor* executor)
+{
+	assert(executor != NULL);
+
+	this->executor = executor;
+	this->size = this->capacity = 0;
+	this->nodes = NULL;
+	this->checked = true;
+	STORE(&this->remaining, 0, RELAXED);
+	STORE(&this->queued, 0, RELAXED);
+	STORE(&this->status, STATUS_SUCCESS, RELAXED);
+
+	return future_init(&this->done);
+}
+
+// Not while running
+static void
+graph_destroy (Graph *const this)
+{
+	assert(LOAD(&this->remaining, RELAXED) == 0);
+
+	for (unsigned i = 0; i < this->size; ++i) {
+		free(this->nodes[i]->successors);
+		free(this->nodes[i]->job);
+	}
+	free(this->nodes);
+	this->nodes = NULL;
+	this->size = this->capacity = 0;
+	future_destroy(&this->done);
+}
+
+static ALWAYS inline unsigned
+graph_size (Graph const*const this)
+{
+	return this->size;
+}
+
+// Copy `data` into a new node; its number is stored in `id`
+static int
+graph_add (Graph *const this, int main(void*), void const* data, size_t size, unsigned id[static 1])
+{
+	if (this->size == this->capacity) {
+		unsigned const capacity = (this->capacity == 0) ? 16 : 2*this->capacity;
+		GraphNode** const nodes = realloc(this->nodes, capacity*sizeof(GraphNode*));
+		if (nodes == NULL) {
+			return STATUS_NOMEM;
+		}
+		this->nodes = nodes;
+		this->capacity = capacity;
+	}
+
+	// the node is the job argument
+	Job *const job = malloc(sizeof(Job) + sizeof(GraphNode) + size);
+	if (job == NULL) {
+		return STATUS_NOMEM;
+	}
+	GraphNode *const node = (GraphNode*)job->data;
+	node->graph = this;
+	node->job = job;
+	node->main = main;
+	node->inputs = node->outputs = node->capacity = 0;
+	node->successors = NULL;
+	STORE(&node->pending, 0, RELAXED);
+	memcpy(node->data, data, size);
+
+	id[0] = this->size;
+	this->nodes[this->size++] = node;
+
+	return STATUS_SUCCESS;
+}
+
+// `to` runs after `from` has finished
+static int
+graph_edge (Graph *const this, unsigned from, unsigned to)
+{
+	assert(from < this->size && to < this->size);
+
+	GraphNode *const node = this->nodes[from];
+	if (node->outputs == node->capacity) {
+		unsigned const capacity = (node->capacity == 0) ? 4 : 2*node->capacity;
+		GraphNode** const successors = realloc(node->successors, capacity*sizeof(GraphNode*));
+		if (successors == NULL) {
+			return STATUS_NOMEM;
+		}
+		node->successors = successors;
+		node->capacity = capacity;
+	}
+	node->successors[node->outputs++] = this->nodes[to];
+	++this->nodes[to]->inputs;
+	this->checked = false;
+
+	return STATUS_SUCCESS;
+}
+
+// Kahn's algorithm: STATUS_ERROR if the graph has a cycle
+static int
+graph_check_ (Graph *const this)
+{
+	if (this->checked) {
+		return STATUS_SUCCESS;
+	}
+	GraphNode** const ready = malloc(this->size*sizeof(GraphNode*));
+	if (ready == NULL) {
+		return STATUS_NOMEM;
+	}
+	unsigned head = 0, tail = 0;
+	for (unsigned i = 0; i < this->size; ++i) {
+		GraphNode *const node = this->nodes[i];
+		STORE(&node->pending, node->inputs, RELAXED);
+		if (node->inputs == 0) {
+			ready[tail++] = node;
+		}
+	}
+	while (head < tail) {
+		GraphNode *const node = ready[head++];
+		for (unsigned i = 0; i < node->outputs; ++i) {
+			if (reg_sub(&node->successors[i]->pending, 1, RELAXED) == 1) {
+				ready[tail++] = node->successors[i];
+			}
+		}
+	}
+	free(ready);
+
+	this->checked = (tail == this->size);
+	return this->checked ? STATUS_SUCCESS : STATUS_ERROR;
+}
+
+static int graph_node_run_(void* data);
+
+static ALWAYS inline void
+graph_push_ (Graph *const this, GraphNode* node)
+{
+	Job *const job = node->job;
+	job->next = NULL;
+	job->main = graph_node_run_;
+	job->join = &this->queued; // the executor keeps the job
+	reg_add(&this->queued, 1, RELAXED);
+	executor_push_(this->executor, job);
+}
+
+static int
+graph_node_run_ (void* data)
+{
+	GraphNode *const node = data;
+	Graph *const this = node->graph;
+
+	int const err = node->main(node->data);
+	if (err != STATUS_SUCCESS) {
+		int expected = STATUS_SUCCESS;
+		CAS(&this->status, &expected, err, RELAXED, RELAXED);
+	}
+	for (unsigned i = 0; i < node->outputs; ++i) {
+		GraphNode *const next = node->successors[i];
+		if (reg_sub(&next->pending, 1, ACQ_REL) == 1) {
+			graph_push_(this, next);
+		}
+	}
+	if (reg_sub(&this->remaining, 1, ACQ_REL) == 1) {
+		future_set(&this->done, Signed(0));
+	}
+	return err;
+}
+
+/*
+ * Run all tasks, each after its predecessors, and wait for them. Returns
+ * the first task error, if any (successors run anyway), or STATUS_ERROR
+ * for cyclic graphs.
+ */
+static int
+graph_run (Graph *const this)
+{
+	int err;
+
+	assert(LOAD(&this->remaining, RELAXED) == 0);
+	if (this->size == 0) {
+		return STATUS_SUCCESS;
+	}
+	catch (graph_check_(this));
+
+	future_destroy(&this->done);
+	catch (future_init(&this->done));
+	STORE(&this->status, STATUS_SUCCESS, RELAXED);
+	STORE(&this->remaining, this->size, RELAXED);
+	for (unsigned i = 0; i < this->size; ++i) {
+		GraphNode *const node = this->nodes[i];
+		STORE(&node->pending, node->inputs, RELAXED);
+	}
+	for (unsigned i = 0; i < this->size; ++i) {
+		if (this->nodes[i]->inputs == 0) {
+			graph_push_(this, this->nodes[i]);
+		}
+	}
+
+	Scalar ignore;
+	if (EXECUTOR_WORKER_ != NULL && EXECUTOR_WORKER_->executor == this->executor) {
+		// help the workers (see `join_sync`)
+		while (!future_ready(&this->done)) {
+			Job *const job = executor_find_(EXECUTOR_WORKER_);
+			if (job != NULL) {
+				executor_run_(this->executor, job);
+			} else {
+				cpu_relax();
+			}
+		}
+	}
+	catch (future_get(&this->done, &ignore));
+	while (LOAD(&this->queued, ACQUIRE) != 0) { // last jobs leaving the executor
+		cpu_relax();
+	}
+
+	return LOAD(&this->status, RELAXED);
+onerror:
+	return err;
+}
+
+#endif // vim:ai:sw=4:ts=4:syntax=cpp
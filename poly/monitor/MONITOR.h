@@ -10,8 +10,12 @@
  *     + auto int err;
  * Assume:
  *     + `syncronized` is the lock
+ *
+ * With `POLY_PROFILE` defined entries are also measured (see profile.h).
  */
 
+#ifndef POLY_PROFILE
+
 #define MONITOR_ENTRY                                            \
     int err;                                                     \
     if ((err=lock_acquire(&this->syncronized))!=STATUS_SUCCESS){ \
@@ -27,4 +31,33 @@ onerror:                                                         \
     lock_release(&this->syncronized);                            \
     return err;
 
+#else
+
+#include "profile.h"
+
+#define MONITOR_ENTRY                                            \
+    int err;                                                     \
+    struct ProfileEntry_ profile_;                               \
+    profile_begin_(&profile_, &this->syncronized);               \
+    if (lock_try(&this->syncronized) != STATUS_SUCCESS) {        \
+        profile_.contended = true;                               \
+        if ((err=lock_acquire(&this->syncronized))!=STATUS_SUCCESS){ \
+            return err;                                          \
+        }                                                        \
+    }                                                            \
+    profile_acquired_(&profile_);
+
+#define ENTRY_END                                                \
+    profile_released_(&profile_);                                \
+    if ((err=lock_release(&this->syncronized))!=STATUS_SUCCESS){ \
+        return err;                                              \
+    }                                                            \
+    return STATUS_SUCCESS;                                       \
+onerror:                                                         \
+    profile_released_(&profile_);                                \
+    lock_release(&this->syncronized);                            \
+    return err;
+
+#endif
+
 #endif // vim:ai:sw=4:ts=4:syntax=cpp
@@ -0,0 +1,87 @@
+#ifndef POLY_FUTEX_H
+#define POLY_FUTEX_H
+
+#ifndef POLY_H
+#include "../POLY.h"
+#endif
+#include "../atomics.h"
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*
+ * Raw Linux futex calls on a 32-bit word, used by the futex backend of
+ * Lock and Condition (see `POLY_FUTEX`). Deadlines are absolute monotonic
+ * Clock values, as everywhere else; a negative deadline waits forever.
+ *
+ * With `POLY_FIBERS` defined waits from a fiber park the fiber, and wakes
+ * serve parked fibers before OS threads.
+ */
+
+////////////////////////////////////////////////////////////////////////
+// Futex interface
+////////////////////////////////////////////////////////////////////////
+
+static int futex_wait(atomic(unsigned)* word, unsigned expected, Clock deadline);
+static int futex_wake(atomic(unsigned)* word, unsigned n);
+
+#ifdef POLY_FIBERS
+#include "../_fiber.h" // uses the interface above
+#endif
+
+////////////////////////////////////////////////////////////////////////
+// Futex implementation
+////////////////////////////////////////////////////////////////////////
+
+static_assert(sizeof(atomic(unsigned)) == 4);
+
+// Sleep while `*word == expected`; spurious returns are STATUS_SUCCESS
+static inline int
+futex_wait (atomic(unsigned)* word, unsigned expected, Clock deadline)
+{
+	struct timespec ts, *timeout = NULL;
+
+#ifdef POLY_FIBERS
+	if (fiber_current() != NULL) {
+		return fiber_futex_wait_(word, expected, deadline);
+	}
+#endif
+	if (deadline >= 0) {
+		ts = ns2timespec(deadline);
+		timeout = &ts;
+	}
+	long const r = syscall(SYS_futex, (unsigned*)word,
+	                       FUTEX_WAIT_BITSET|FUTEX_PRIVATE_FLAG, // CLOCK_MONOTONIC
+	                       expected, timeout, NULL, FUTEX_BITSET_MATCH_ANY);
+	if (r == 0) {
+		return STATUS_SUCCESS;
+	}
+	switch (errno) {
+		case EAGAIN: // the word changed before sleeping
+		case EINTR:
+			return STATUS_SUCCESS;
+		case ETIMEDOUT:
+			return STATUS_TIMEDOUT;
+		default:
+			return STATUS_ERROR;
+	}
+}
+
+// Wake up to `n` sleepers on `word`
+static ALWAYS inline int
+futex_wake (atomic(unsigned)* word, unsigned n)
+{
+#ifdef POLY_FIBERS
+	if ((n -= fiber_futex_wake_(word, n)) == 0) {
+		return STATUS_SUCCESS;
+	}
+#endif
+	if (n > INT_MAX) { n = INT_MAX; }
+	long const r = syscall(SYS_futex, (unsigned*)word,
+	                       FUTEX_WAKE|FUTEX_PRIVATE_FLAG, n, NULL, NULL, 0);
+	return (r < 0) ? STATUS_ERROR : STATUS_SUCCESS;
+}
+
+#endif // vim:ai:sw=4:ts=4:syntax=cpp
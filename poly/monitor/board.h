@@ -21,6 +21,7 @@
 
 static int  board_init(unsigned n, Notice board[static n], union Lock lock);
 static void board_destroy(unsigned n, Notice board[static n]);
+static void board_spin_limit(unsigned n, Notice board[static n], unsigned limit);
 
 static int  board_meet(Notice board[static 2], unsigned i);
 
@@ -60,6 +61,15 @@ board_destroy (unsigned n, Notice board[static n])
 	} while (n != 0);
 }
 
+// Set the spin budget limit for all notices (call with the lock held)
+static inline void
+board_spin_limit (unsigned n, Notice board[static n], unsigned limit)
+{
+	for (unsigned i = 0; i < n; ++i) {
+		notice_spin_limit(&board[i], limit);
+	}
+}
+
 /*
  * Operations on 2 elements board.
  */
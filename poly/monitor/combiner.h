@@ -0,0 +1,128 @@
+#ifndef POLY_COMBINER_H
+#define POLY_COMBINER_H
+
+#ifndef POLY_H
+#include "../POLY.h"
+#endif
+#include "../atomics.h"
+#include "lock.h"
+
+/*
+ * Flat combining (Hendler, Incze, Shavit and Tzafrir): callers publish
+ * their operation in a request record, on their own stack, and the thread
+ * that wins the combiner lock runs the whole batch of published requests
+ * before releasing it. Under contention the protected data stays in the
+ * cache of one core, and each waiter spins only on its own record.
+ *
+ * Operations run in the combining thread, maybe not the caller's, and must
+ * not block.
+ */
+
+////////////////////////////////////////////////////////////////////////
+// Combiner interface
+////////////////////////////////////////////////////////////////////////
+
+typedef struct Combiner {
+	SpinLock                             syncronized;
+	CACHE_ALIGNED
+	atomic(struct CombinerRequest_*)     requests; // published, not taken
+} Combiner;
+
+static int  combiner_init(Combiner *const this);
+static void combiner_destroy(Combiner *const this);
+static void combiner_execute(Combiner *const this, void operation(void*), void* argument);
+
+/*
+ *  Combiner c;
+ *  catch (combiner_init(&c));
+ *
+ *  inline void increment(void* ignore) { ++counter; }
+ *  combiner_execute(&c, increment, NULL);
+ */
+
+////////////////////////////////////////////////////////////////////////
+// Combiner implementation
+////////////////////////////////////////////////////////////////////////
+
+enum { COMBINER_PASSES=4 }; // batches taken by a combining thread
+
+// private: a published operation
+struct CombinerRequest_ {
+	struct CombinerRequest_*  next;
+	void                    (*operation)(void*);
+	void*                     argument;
+	atomic(bool)              done;
+};
+
+static int
+combiner_init (Combiner *const this)
+{
+	STORE(&this->requests, NULL, RELAXED);
+	return lock_init(&this->syncronized);
+}
+
+static void
+combiner_destroy (Combiner *const this)
+{
+	assert(LOAD(&this->requests, RELAXED) == NULL);
+	lock_destroy(&this->syncronized);
+}
+
+// Run the published requests, oldest first (lock held)
+static void
+combiner_run_ (Combiner *const this)
+{
+	for (unsigned pass = 0; pass < COMBINER_PASSES; ++pass) {
+		struct CombinerRequest_* request = SWAP(&this->requests, NULL, ACQUIRE);
+		if (request == NULL) {
+			break;
+		}
+		struct CombinerRequest_* order = NULL;
+		while (request != NULL) {
+			struct CombinerRequest_ *const next = request->next;
+			request->next = order;
+			order = request;
+			request = next;
+		}
+		while (order != NULL) {
+			struct CombinerRequest_ *const next = order->next;
+			order->operation(order->argument);
+			STORE(&order->done, true, RELEASE); // the record can vanish now
+			order = next;
+		}
+	}
+}
+
+/*
+ * Run `operation(argument)` under the combiner lock, in this thread or in
+ * the combining one, and return when done.
+ */
+static void
+combiner_execute (Combiner *const this, void operation(void*), void* argument)
+{
+	struct CombinerRequest_ request = {
+		.operation = operation,
+		.argument  = argument,
+	};
+	STORE(&request.done, false, RELAXED);
+
+	struct CombinerRequest_* head = LOAD(&this->requests, RELAXED);
+	do {
+		request.next = head;
+	} while (!CASw(&this->requests, &head, &request, RELEASE, RELAXED));
+
+	unsigned round = 0;
+	while (!LOAD(&request.done, ACQUIRE)) {
+		if (lock_try(&this->syncronized) == STATUS_SUCCESS) {
+			// published before locking: this batch includes it, or a
+			// previous combiner has already run it
+			combiner_run_(this);
+			lock_release(&this->syncronized);
+			assert(LOAD(&request.done, RELAXED));
+			break;
+		}
+		lock_backoff_(&round);
+	}
+}
+
+#endif // vim:ai:sw=4:ts=4:syntax=cpp
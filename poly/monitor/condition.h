@@ -8,28 +8,55 @@
 #include "MONITOR.h"
 #endif
 #include "lock.h"
+#include "profile.h"
+#ifdef POLY_TIMER_WHEEL
+#include "../timer.h"
+#endif
 
 /*
- * A thin façade renaming on top of C11 type `cnd_t`.
+ * A thin façade renaming on top of C11 type `cnd_t`, or a sequence counter
+ * on a Linux futex if `POLY_FUTEX` is defined. With `POLY_TIMER_WHEEL`
+ * defined timed waits are woken by the default timer wheel: each timed
+ * waiter sleeps on its own word, so an alarm wakes only its owner.
  */
 
 ////////////////////////////////////////////////////////////////////////
 // Condition interface
 ////////////////////////////////////////////////////////////////////////
 
+#ifndef POLY_FUTEX
+
 typedef cnd_t Condition;
 
+#else
+
+typedef struct Condition {
+	atomic(unsigned) sequence; // futex word, bumped by each signal
+	atomic(unsigned) waiters;  // # of sleepers (saves wake calls)
+#ifdef POLY_TIMER_WHEEL
+	atomic(unsigned) timed;    // # of timed sleepers in `alarms`
+	SpinLock         guard;    // protects `alarms`
+	struct ConditionAlarm_*  alarms; // timed sleepers, oldest first
+	struct ConditionAlarm_** last;
+#endif
+} Condition;
+
+#endif
+
 static int  condition_broadcast(Condition *const this);
 static void condition_destroy(Condition *const this);
 static int  condition_init(Condition *const this);
 static int  condition_signal(Condition *const this);
 static int  condition_wait(Condition *const this, union Lock lock);
 static int  condition_wait_for(Condition *const this, union Lock lock, Clock duration);
+static int  condition_wait_until(Condition *const this, union Lock lock, Clock deadline);
 
 ////////////////////////////////////////////////////////////////////////
 // Condition implementation
 ////////////////////////////////////////////////////////////////////////
 
+#ifndef POLY_FUTEX
+
 static ALWAYS inline int
 condition_init (Condition *const this)
 {
@@ -51,7 +78,7 @@ condition_signal (Condition *const this)
 static ALWAYS inline int
 condition_wait (Condition *const this, union Lock lock)
 {
-	return cnd_wait(this, lock.mutex);
+	return PROFILE_WAIT(lock.mutex, cnd_wait(this, lock.mutex));
 }
 
 static ALWAYS inline int
@@ -60,13 +87,234 @@ condition_broadcast (Condition *const this)
 	return cnd_broadcast(this);
 }
 
+// glibc `cnd_t` and `mtx_t` wrap the pthread types: wait on the monotonic clock
+static inline int
+condition_clockwait_ (Condition *const this, union Lock lock, Clock deadline)
+{
+	struct timespec const ts = ns2timespec(deadline);
+	switch (pthread_cond_clockwait((pthread_cond_t*)this, (pthread_mutex_t*)lock.mutex, CLOCK_MONOTONIC, &ts)) {
+		case 0:         return STATUS_SUCCESS;
+		case ETIMEDOUT: return STATUS_TIMEDOUT;
+		default:        return STATUS_ERROR;
+	}
+}
+
+static inline int
+condition_wait_until (Condition *const this, union Lock lock, Clock deadline)
+{
+	return PROFILE_WAIT(lock.mutex, condition_clockwait_(this, lock, deadline));
+}
+
+#else
+
+#ifdef POLY_TIMER_WHEEL
+
+// private: a timed sleeper, on its own stack
+struct ConditionAlarm_ {
+	struct ConditionAlarm_*  next;
+	struct ConditionAlarm_** link; // to this record in `alarms`; NULL if out
+	atomic(unsigned)         word; // futex
+	Timer                    timer;
+};
+
+// Alarm word values
+enum { CONDITION_SLEEPING=0, CONDITION_SIGNALED, CONDITION_EXPIRED };
+
+#endif
+
+static ALWAYS inline int
+condition_init (Condition *const this)
+{
+	STORE(&this->sequence, 0, RELAXED);
+	STORE(&this->waiters, 0, RELAXED);
+#ifdef POLY_TIMER_WHEEL
+	STORE(&this->timed, 0, RELAXED);
+	this->alarms = NULL;
+	this->last = &this->alarms;
+	return lock_init(&this->guard);
+#else
+	return STATUS_SUCCESS;
+#endif
+}
+
+static ALWAYS inline void
+condition_destroy (Condition *const this)
+{
+	assert(LOAD(&this->waiters, RELAXED) == 0);
+	(void)this;
+#ifdef POLY_TIMER_WHEEL
+	assert(this->alarms == NULL);
+	lock_destroy(&this->guard);
+#endif
+}
+
+#ifdef POLY_TIMER_WHEEL
+
+// Unlink `alarm` from `alarms` (guard held)
+static ALWAYS inline void
+condition_unlink_ (Condition *const this, struct ConditionAlarm_ *const alarm)
+{
+	if ((*alarm->link=alarm->next) == NULL) {
+		this->last = alarm->link;
+	} else {
+		alarm->next->link = alarm->link;
+	}
+	alarm->link = NULL;
+	reg_sub(&this->timed, 1);
+}
+
+/*
+ * Wake the oldest timed sleepers not expired yet, up to `n`, and return how
+ * many were woken. The waker holds the guard until the wakes are done, and
+ * the sleepers take it before leaving: their records outlive the wakes.
+ */
+static inline unsigned
+condition_wake_timed_ (Condition *const this, unsigned n)
+{
+	unsigned woken = 0;
+	lock_acquire(&this->guard);
+	while (woken < n && this->alarms != NULL) {
+		struct ConditionAlarm_ *const alarm = this->alarms;
+		condition_unlink_(this, alarm);
+		unsigned sleeping = CONDITION_SLEEPING;
+		if (CAS(&alarm->word, &sleeping, CONDITION_SIGNALED)) {
+			futex_wake(&alarm->word, 1);
+			++woken;
+		}
+	}
+	lock_release(&this->guard);
+	return woken;
+}
+
+// The alarm of a timed wait: wakes only its owner
+static void
+condition_alarm_ (void* argument)
+{
+	struct ConditionAlarm_ *const alarm = argument;
+	unsigned sleeping = CONDITION_SLEEPING;
+	if (CAS(&alarm->word, &sleeping, CONDITION_EXPIRED)) {
+		futex_wake(&alarm->word, 1);
+	}
+}
+
+#endif
+
+static ALWAYS inline int
+condition_signal (Condition *const this)
+{
+#ifdef POLY_TIMER_WHEEL
+	if (LOAD(&this->timed) != 0 && condition_wake_timed_(this, 1) == 1) {
+		return STATUS_SUCCESS;
+	}
+#endif
+	reg_add(&this->sequence, 1);
+	return LOAD(&this->waiters) == 0 ? STATUS_SUCCESS : futex_wake(&this->sequence, 1);
+}
+
+static ALWAYS inline int
+condition_broadcast (Condition *const this)
+{
+#ifdef POLY_TIMER_WHEEL
+	if (LOAD(&this->timed) != 0) {
+		condition_wake_timed_(this, UINT_MAX);
+	}
+#endif
+	reg_add(&this->sequence, 1);
+	return LOAD(&this->waiters) == 0 ? STATUS_SUCCESS : futex_wake(&this->sequence, INT_MAX);
+}
+
+#ifdef POLY_TIMER_WHEEL
+
+// Sleep while no signal or alarm is received
+static inline int
+condition_sleep_ (struct ConditionAlarm_ *const alarm)
+{
+	int err = STATUS_SUCCESS;
+	while (LOAD(&alarm->word, ACQUIRE) == CONDITION_SLEEPING) {
+		if ((err=futex_wait(&alarm->word, CONDITION_SLEEPING, -1)) != STATUS_SUCCESS) {
+			break;
+		}
+	}
+	return err;
+}
+
+// Timed wait on its own word, armed on the default wheel
+static inline int
+condition_wait_timed_ (Condition *const this, union Lock lock, Clock deadline)
+{
+	int err;
+
+	if (now() >= deadline) {
+		return STATUS_TIMEDOUT;
+	}
+	struct ConditionAlarm_ alarm = { .next=NULL };
+	STORE(&alarm.word, CONDITION_SLEEPING, RELAXED);
+
+	lock_acquire(&this->guard);
+	alarm.link = this->last;
+	*this->last = &alarm;
+	this->last = &alarm.next;
+	reg_add(&this->timed, 1);
+	lock_release(&this->guard);
+
+	TimerWheel *const wheel = timer_wheel_default();
+	timer_init(&alarm.timer, condition_alarm_, &alarm);
+	timer_start(wheel, &alarm.timer, deadline, 0);
+
+	if ((err=lock_release(lock)) == STATUS_SUCCESS) {
+		err = PROFILE_WAIT(lock.mutex, condition_sleep_(&alarm));
+	}
+	timer_cancel(wheel, &alarm.timer); // waits for a running alarm
+
+	lock_acquire(&this->guard); // a waker may still hold the record
+	if (alarm.link != NULL) {
+		condition_unlink_(this, &alarm);
+	}
+	lock_release(&this->guard);
+
+	if (err == STATUS_SUCCESS && LOAD(&alarm.word, RELAXED) == CONDITION_EXPIRED) {
+		err = STATUS_TIMEDOUT;
+	}
+	int const e = lock_acquire(lock);
+	return (err != STATUS_SUCCESS) ? err : e;
+}
+
+#endif
+
+// Spurious wakeups are possible, as with `cnd_wait`
+static inline int
+condition_wait_until (Condition *const this, union Lock lock, Clock deadline)
+{
+	int err;
+
+#ifdef POLY_TIMER_WHEEL
+	if (deadline >= 0) {
+		return condition_wait_timed_(this, lock, deadline);
+	}
+#endif
+	unsigned const sequence = LOAD(&this->sequence, RELAXED);
+	reg_add(&this->waiters, 1);
+	if ((err=lock_release(lock)) == STATUS_SUCCESS) {
+		err = PROFILE_WAIT(lock.mutex, futex_wait(&this->sequence, sequence, deadline));
+	}
+	reg_sub(&this->waiters, 1);
+
+	int const e = lock_acquire(lock);
+	return (err != STATUS_SUCCESS) ? err : e;
+}
+
+static ALWAYS inline int
+condition_wait (Condition *const this, union Lock lock)
+{
+	return condition_wait_until(this, lock, -1);
+}
+
+#endif
+
 static inline int
 condition_wait_for (Condition *const this, union Lock lock, Clock duration)
 {
-	const Clock  t  = now() + duration; // Clock ticks are nanoseconds
-	const time_t s  = ns2s(t);
-	const long   ns = t - s2ns(s);
-	return cnd_timedwait(this, lock.mutex, &(struct timespec){.tv_sec=s, .tv_nsec=ns});
+	return condition_wait_until(this, lock, now() + duration); // Clock ticks are nanoseconds
 }
 
 #endif // vim:ai:sw=4:ts=4:syntax=cpp
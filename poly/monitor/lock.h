@@ -7,10 +7,30 @@
 #ifndef POLY_MONITOR_H
 #include "MONITOR.h"
 #endif
+#include "../atomics.h"
+#ifdef POLY_FUTEX
+#include "_futex.h"
+#else
+#include <pthread.h>
+// GNU extensions of <pthread.h>, with `mtx_t` and `cnd_t` wrapping them
+extern int pthread_mutex_clocklock(pthread_mutex_t*, clockid_t, struct timespec const*);
+extern int pthread_cond_clockwait(pthread_cond_t*, pthread_mutex_t*, clockid_t, struct timespec const*);
+#endif
 
+//#include <stdlib.h>
+extern void free(void*);
+extern int  posix_memalign(void**, size_t, size_t);
 
 /*
- * A façade on top of C11 type `mtx_t`.
+ * A façade on top of C11 type `mtx_t`, or on top of Linux futexes if
+ * `POLY_FUTEX` is defined.
+ *
+ * For very short critical sections there are also busy waiting locks, built
+ * only on atomics: `SpinLock` (test and test-and-set), `TicketLock` (FIFO)
+ * and the queue locks `MCSLock` and `CLHLock` (FIFO, each waiter spinning
+ * on its own cache line). They share the `lock_*` macros, but cannot be
+ * used with conditions, have no `lock_try_for`, and `CLHLock` has no
+ * `lock_try`. Never block while holding them.
  */
 
 ////////////////////////////////////////////////////////////////////////
@@ -27,15 +47,49 @@
  *
  * with `mask` deduced from lock type
  *
+ *  SpinLock s; // or TicketLock, MCSLock, CLHLock
+ *  lock_init(&s)
+ *  lock_acquire(&s)
+ *
+ * expand to calls of the spin lock functions
+ *
  */
 
-typedef struct { mtx_t mutex; } PlainLock;
-typedef struct { mtx_t mutex; } TimedLock;
-typedef struct { mtx_t mutex; } RecursiveLock;
-typedef struct { mtx_t mutex; } TimedRecursiveLock;
+#ifndef POLY_FUTEX
+
+typedef mtx_t Mutex;
+
+typedef struct { Mutex mutex; } PlainLock;
+typedef struct { Mutex mutex; } TimedLock;
+typedef struct { Mutex mutex; } RecursiveLock;
+typedef struct { Mutex mutex; } TimedRecursiveLock;
+
+#else
+
+/*
+ * With `POLY_FUTEX` defined locks are a 32-bit Linux futex word: two bits
+ * of state (free, locked, locked with sleepers) and a kind bit. Recursive
+ * locks add the owner (the thread, or with `POLY_FIBERS` the running fiber)
+ * and the nesting depth.
+ */
+
+typedef struct Mutex { atomic(unsigned) word; } Mutex;
+
+struct RecursiveMutex {
+	Mutex            base;
+	atomic(thrd_t)   owner;
+	unsigned         depth;
+};
+
+typedef struct { Mutex mutex; } PlainLock;
+typedef struct { Mutex mutex; } TimedLock;
+typedef struct { struct RecursiveMutex mutex; } RecursiveLock;
+typedef struct { struct RecursiveMutex mutex; } TimedRecursiveLock;
+
+#endif
 
 union POLY_TRANSPARENT Lock {
-	mtx_t* mutex;
+	Mutex* mutex;
 	PlainLock* _1;
 	TimedLock* _2;
 	RecursiveLock* _3;
@@ -46,6 +100,31 @@ union POLY_TRANSPARENT Lock {
 typedef PlainLock               Lock;
 typedef TimedRecursiveLock      RecursiveTimedLock;
 
+// private: queue lock node
+struct LockNode_ {
+	CACHE_ALIGNED
+	atomic(struct LockNode_*) next;   // MCS successor; CLH spare list
+	atomic(bool)              locked;
+};
+
+typedef struct { atomic(bool) locked; } SpinLock;
+
+typedef struct {
+	atomic(unsigned)  next;     // next ticket to give
+	atomic(unsigned)  serving;  // ticket holding the lock
+} TicketLock;
+
+typedef struct {
+	atomic(struct LockNode_*) tail;
+	struct LockNode_*         holder;
+} MCSLock;
+
+typedef struct {
+	atomic(struct LockNode_*) tail;
+	struct LockNode_*         holder;
+	struct LockNode_*         pred;     // recycled by the holder on release
+} CLHLock;
+
 static int  lock_acquire(union Lock this);
 static void lock_destroy(union Lock this);
 // macro:   lock_init(union Lock this)
@@ -58,20 +137,14 @@ static int  lock_try_for(union Lock this, Clock duration);
 // Lock implementation
 ////////////////////////////////////////////////////////////////////////
 
+#ifndef POLY_FUTEX
+
 static ALWAYS inline int
 lock_init (union Lock this, unsigned mask)
 {
 	return mtx_init(this.mutex, mask);
 }
 
-// Deduce mask from lock type, and calls lock_init function
-#define lock_init(LOCK) lock_init((LOCK),        \
-    _Generic((LOCK),                             \
-        PlainLock*: mtx_plain,                   \
-        TimedLock*: mtx_timed,                   \
-        RecursiveLock*: mtx_plain|mtx_recursive, \
-        TimedRecursiveLock*: mtx_timed|mtx_recursive))
-
 static ALWAYS inline void
 lock_destroy (union Lock this)
 {
@@ -96,13 +169,548 @@ lock_try (union Lock this)
 	return mtx_trylock(this.mutex);
 }
 
+// glibc `mtx_t` wraps `pthread_mutex_t`: wait on the monotonic clock
+static inline int
+lock_try_for (union Lock this, Clock duration)
+{
+	struct timespec const ts = ns2timespec(now() + duration); // Clock ticks are nanoseconds
+	switch (pthread_mutex_clocklock((pthread_mutex_t*)this.mutex, CLOCK_MONOTONIC, &ts)) {
+		case 0:         return STATUS_SUCCESS;
+		case ETIMEDOUT: return STATUS_TIMEDOUT;
+		default:        return STATUS_ERROR;
+	}
+}
+
+#else
+
+enum {
+	LOCK_FREE_      = 0u,
+	LOCK_LOCKED_    = 1u,
+	LOCK_CONTENDED_ = 2u,
+	LOCK_STATE_     = 3u,  // state bits mask
+	LOCK_RECURSIVE_ = 4u,  // kind bit
+};
+
+static ALWAYS inline int
+lock_init (union Lock this, unsigned mask)
+{
+	// mtx_timed is ignored: all futex locks accept timeouts
+	if (mask & mtx_recursive) {
+		struct RecursiveMutex* r = (struct RecursiveMutex*)this.mutex;
+		STORE(&r->owner, (thrd_t)0, RELAXED);
+		r->depth = 0;
+		STORE(&this.mutex->word, LOCK_RECURSIVE_|LOCK_FREE_, RELAXED);
+	} else {
+		STORE(&this.mutex->word, LOCK_FREE_, RELAXED);
+	}
+	return STATUS_SUCCESS;
+}
+
+static ALWAYS inline void
+lock_destroy (union Lock this)
+{
+	assert((LOAD(&this.mutex->word, RELAXED) & LOCK_STATE_) == LOCK_FREE_);
+	(void)this;
+}
+
+/*
+ * The futex word protocol: uncontended acquire and release are a single
+ * CAS and a single swap; sleepers mark the word as contended, and only
+ * then the releaser pays for a wake call.
+ */
+
+static ALWAYS inline bool
+lock_word_try_ (Mutex *const this)
+{
+	unsigned const kind = LOAD(&this->word, RELAXED) & ~LOCK_STATE_;
+	unsigned expected = kind|LOCK_FREE_;
+	return CAS(&this->word, &expected, kind|LOCK_LOCKED_, ACQUIRE, RELAXED);
+}
+
+static inline int
+lock_word_wait_ (Mutex *const this, Clock deadline)
+{
+	unsigned const kind = LOAD(&this->word, RELAXED) & ~LOCK_STATE_;
+	unsigned const contended = kind|LOCK_CONTENDED_;
+
+	while ((SWAP(&this->word, contended, ACQUIRE) & LOCK_STATE_) != LOCK_FREE_) {
+		int const err = futex_wait(&this->word, contended, deadline);
+		if (err != STATUS_SUCCESS) { return err; }
+	}
+	return STATUS_SUCCESS;
+}
+
+static ALWAYS inline int
+lock_word_acquire_ (Mutex *const this, Clock deadline)
+{
+	return lock_word_try_(this) ? STATUS_SUCCESS : lock_word_wait_(this, deadline);
+}
+
+static ALWAYS inline int
+lock_word_release_ (Mutex *const this)
+{
+	unsigned const kind = LOAD(&this->word, RELAXED) & ~LOCK_STATE_;
+	unsigned const c = SWAP(&this->word, kind|LOCK_FREE_, RELEASE);
+	assert((c & LOCK_STATE_) != LOCK_FREE_);
+	return ((c & LOCK_STATE_) == LOCK_CONTENDED_) ? futex_wake(&this->word, 1) : STATUS_SUCCESS;
+}
+
+/*
+ * Recursive locks wrap the word protocol with owner and depth bookkeeping,
+ * out of line to keep plain locks small at every call site.
+ */
+
+// The caller identity: fibers sharing a thread must not reenter each other
+static ALWAYS inline thrd_t
+lock_owner_ (void)
+{
+#ifdef POLY_FIBERS
+	Fiber *const fiber = fiber_current();
+	if (fiber != NULL) {
+		return (thrd_t)fiber;
+	}
+#endif
+	return thrd_current();
+}
+
+static __attribute__((noinline)) int
+lock_recursive_acquire_ (struct RecursiveMutex *const this, Clock deadline, bool try)
+{
+	thrd_t const self = lock_owner_();
+	if (LOAD(&this->owner, RELAXED) == self) {
+		++this->depth;
+		return STATUS_SUCCESS;
+	}
+	if (try) {
+		if (!lock_word_try_(&this->base)) { return STATUS_BUSY; }
+	} else {
+		int const err = lock_word_acquire_(&this->base, deadline);
+		if (err != STATUS_SUCCESS) { return err; }
+	}
+	STORE(&this->owner, self, RELAXED);
+	this->depth = 1;
+	return STATUS_SUCCESS;
+}
+
+static __attribute__((noinline)) int
+lock_recursive_release_ (struct RecursiveMutex *const this)
+{
+	assert(LOAD(&this->owner, RELAXED) == lock_owner_());
+	if (--this->depth > 0) {
+		return STATUS_SUCCESS;
+	}
+	STORE(&this->owner, (thrd_t)0, RELAXED);
+	return lock_word_release_(&this->base);
+}
+
+static ALWAYS inline bool
+lock_recursive_ (union Lock this)
+{
+	return LOAD(&this.mutex->word, RELAXED) & LOCK_RECURSIVE_;
+}
+
+static ALWAYS inline int
+lock_acquire (union Lock this)
+{
+	return lock_recursive_(this)
+		? lock_recursive_acquire_((struct RecursiveMutex*)this.mutex, -1, false)
+		: lock_word_acquire_(this.mutex, -1);
+}
+
+static ALWAYS inline int
+lock_release (union Lock this)
+{
+	return lock_recursive_(this)
+		? lock_recursive_release_((struct RecursiveMutex*)this.mutex)
+		: lock_word_release_(this.mutex);
+}
+
+static ALWAYS inline int
+lock_try (union Lock this)
+{
+	if (lock_recursive_(this)) {
+		return lock_recursive_acquire_((struct RecursiveMutex*)this.mutex, -1, true);
+	}
+	return lock_word_try_(this.mutex) ? STATUS_SUCCESS : STATUS_BUSY;
+}
+
 static inline int
 lock_try_for (union Lock this, Clock duration)
 {
-	const Clock  t  = now() + duration; // Clock ticks are nanoseconds
-	const time_t s  = ns2s(t);
-	const long   ns = t - s2ns(s);
-	return mtx_timedlock(this.mutex, &(struct timespec){.tv_sec=s, .tv_nsec=ns});
+	Clock const deadline = now() + duration; // Clock ticks are nanoseconds
+	return lock_recursive_(this)
+		? lock_recursive_acquire_((struct RecursiveMutex*)this.mutex, deadline, false)
+		: lock_word_acquire_(this.mutex, deadline);
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////
+// Spin locks
+////////////////////////////////////////////////////////////////////////
+
+#ifndef POLY_LOCK_NODES
+#define POLY_LOCK_NODES 8 // MCS locks held at once by a thread
+#endif
+
+enum { LOCK_SPIN_ = 6 }; // up to 2^6 pauses, then yield
+
+// Exponential backoff
+static ALWAYS inline void
+lock_backoff_ (unsigned round[static 1])
+{
+	if (*round < LOCK_SPIN_) {
+		for (unsigned i = 1u << *round; i > 0; --i) {
+			cpu_relax();
+		}
+		++*round;
+	} else {
+		thrd_yield();
+	}
+}
+
+static ALWAYS inline int
+lock_spin_init_ (SpinLock *const this, unsigned mask)
+{
+	(void)mask;
+	STORE(&this->locked, false, RELAXED);
+	return STATUS_SUCCESS;
 }
 
+static ALWAYS inline void
+lock_spin_destroy_ (SpinLock *const this)
+{
+	assert(!LOAD(&this->locked, RELAXED));
+	(void)this;
+}
+
+static ALWAYS inline int
+lock_spin_try_ (SpinLock *const this)
+{
+	return (!LOAD(&this->locked, RELAXED) && !SWAP(&this->locked, true, ACQUIRE))
+		? STATUS_SUCCESS : STATUS_BUSY;
+}
+
+static ALWAYS inline int
+lock_spin_acquire_ (SpinLock *const this)
+{
+	unsigned round = 0;
+	while (SWAP(&this->locked, true, ACQUIRE)) {
+		do { // spin reading the cached line
+			lock_backoff_(&round);
+		} while (LOAD(&this->locked, RELAXED));
+	}
+	return STATUS_SUCCESS;
+}
+
+static ALWAYS inline int
+lock_spin_release_ (SpinLock *const this)
+{
+	STORE(&this->locked, false, RELEASE);
+	return STATUS_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+static ALWAYS inline int
+lock_ticket_init_ (TicketLock *const this, unsigned mask)
+{
+	(void)mask;
+	STORE(&this->next, 0, RELAXED);
+	STORE(&this->serving, 0, RELAXED);
+	return STATUS_SUCCESS;
+}
+
+static ALWAYS inline void
+lock_ticket_destroy_ (TicketLock *const this)
+{
+	assert(LOAD(&this->next, RELAXED) == LOAD(&this->serving, RELAXED));
+	(void)this;
+}
+
+static ALWAYS inline int
+lock_ticket_try_ (TicketLock *const this)
+{
+	unsigned ticket = LOAD(&this->serving, RELAXED);
+	return CAS(&this->next, &ticket, ticket+1, ACQUIRE, RELAXED) ? STATUS_SUCCESS : STATUS_BUSY;
+}
+
+static ALWAYS inline int
+lock_ticket_acquire_ (TicketLock *const this)
+{
+	unsigned const ticket = reg_add(&this->next, 1, RELAXED);
+	unsigned serving, round = 0;
+	while ((serving=LOAD(&this->serving, ACQUIRE)) != ticket) {
+		if (ticket - serving > 1) { // not next: let the others run
+			thrd_yield();
+		} else {
+			lock_backoff_(&round);
+		}
+	}
+	return STATUS_SUCCESS;
+}
+
+static ALWAYS inline int
+lock_ticket_release_ (TicketLock *const this)
+{
+	// only the holder writes `serving`
+	STORE(&this->serving, LOAD(&this->serving, RELAXED)+1, RELEASE);
+	return STATUS_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+/*
+ * MCS: waiters queue their own node and spin on it; the holder hands the
+ * lock over to its successor. Nodes are taken from a small per thread
+ * array, so locks can be released in any order.
+ */
+
+static _Thread_local struct LockNode_ LOCK_MCS_NODES_[POLY_LOCK_NODES];
+static _Thread_local unsigned         LOCK_MCS_USED_ = 0; // bitmap
+
+static_assert(POLY_LOCK_NODES <= 32);
+
+static ALWAYS inline struct LockNode_*
+lock_node_get_ (void)
+{
+	if (LOCK_MCS_USED_ == (unsigned)((1ull << POLY_LOCK_NODES) - 1)) {
+		panic("too many MCS locks held");
+	}
+	unsigned const i = __builtin_ctz(~LOCK_MCS_USED_);
+	LOCK_MCS_USED_ |= 1u << i;
+	return &LOCK_MCS_NODES_[i];
+}
+
+static ALWAYS inline void
+lock_node_put_ (struct LockNode_* node)
+{
+	LOCK_MCS_USED_ &= ~(1u << (node - LOCK_MCS_NODES_));
+}
+
+static ALWAYS inline int
+lock_mcs_init_ (MCSLock *const this, unsigned mask)
+{
+	(void)mask;
+	STORE(&this->tail, NULL, RELAXED);
+	this->holder = NULL;
+	return STATUS_SUCCESS;
+}
+
+static ALWAYS inline void
+lock_mcs_destroy_ (MCSLock *const this)
+{
+	assert(LOAD(&this->tail, RELAXED) == NULL);
+	(void)this;
+}
+
+static ALWAYS inline int
+lock_mcs_try_ (MCSLock *const this)
+{
+	struct LockNode_ *const node = lock_node_get_();
+	struct LockNode_* expected = NULL;
+	STORE(&node->next, NULL, RELAXED);
+	if (!CAS(&this->tail, &expected, node, ACQUIRE, RELAXED)) {
+		lock_node_put_(node);
+		return STATUS_BUSY;
+	}
+	this->holder = node;
+	return STATUS_SUCCESS;
+}
+
+static inline int
+lock_mcs_acquire_ (MCSLock *const this)
+{
+	struct LockNode_ *const node = lock_node_get_();
+	STORE(&node->next, NULL, RELAXED);
+	STORE(&node->locked, true, RELAXED);
+
+	struct LockNode_ *const pred = SWAP(&this->tail, node, ACQ_REL);
+	if (pred != NULL) {
+		STORE(&pred->next, node, RELEASE);
+		unsigned round = 0;
+		while (LOAD(&node->locked, ACQUIRE)) {
+			lock_backoff_(&round);
+		}
+	}
+	this->holder = node;
+	return STATUS_SUCCESS;
+}
+
+static inline int
+lock_mcs_release_ (MCSLock *const this)
+{
+	struct LockNode_ *const node = this->holder;
+	struct LockNode_* next = LOAD(&node->next, ACQUIRE);
+
+	if (next == NULL) {
+		struct LockNode_* expected = node;
+		if (CAS(&this->tail, &expected, NULL, RELEASE, RELAXED)) {
+			lock_node_put_(node);
+			return STATUS_SUCCESS;
+		}
+		while ((next=LOAD(&node->next, ACQUIRE)) == NULL) { // successor linking
+			cpu_relax();
+		}
+	}
+	STORE(&next->locked, false, RELEASE);
+	lock_node_put_(node);
+	return STATUS_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+/*
+ * CLH: waiters swap their node into the tail and spin on the node of their
+ * predecessor, which they keep on acquiring. Nodes travel among threads,
+ * so they live in the heap: each thread keeps a list of spare nodes, freed
+ * when the thread exits.
+ */
+
+static _Thread_local struct LockNode_* LOCK_CLH_SPARE_ = NULL;
+static tss_t     LOCK_CLH_KEY_;
+static once_flag LOCK_CLH_ONCE_ = ONCE_FLAG_INIT;
+
+static void
+lock_clh_exit_ (void* ignore)
+{
+	(void)ignore;
+	struct LockNode_* node = LOCK_CLH_SPARE_;
+	while (node != NULL) {
+		struct LockNode_ *const next = LOAD(&node->next, RELAXED);
+		free(node);
+		node = next;
+	}
+	LOCK_CLH_SPARE_ = NULL;
+}
+
+static void
+lock_clh_key_ (void)
+{
+	if (tss_create(&LOCK_CLH_KEY_, lock_clh_exit_) != thrd_success) {
+		panic("cannot create the CLH nodes key");
+	}
+}
+
+static inline struct LockNode_*
+lock_clh_node_ (void)
+{
+	struct LockNode_* node = LOCK_CLH_SPARE_;
+	if (node != NULL) {
+		LOCK_CLH_SPARE_ = LOAD(&node->next, RELAXED);
+		return node;
+	}
+	call_once(&LOCK_CLH_ONCE_, lock_clh_key_);
+	if (tss_get(LOCK_CLH_KEY_) == NULL) { // first node: free the list on exit
+		tss_set(LOCK_CLH_KEY_, &LOCK_CLH_SPARE_);
+	}
+	if (posix_memalign((void**)&node, CACHE_LINE, sizeof(struct LockNode_)) != 0) {
+		return NULL;
+	}
+	return node;
+}
+
+static ALWAYS inline void
+lock_clh_spare_ (struct LockNode_* node)
+{
+	STORE(&node->next, LOCK_CLH_SPARE_, RELAXED);
+	LOCK_CLH_SPARE_ = node;
+}
+
+static inline int
+lock_clh_init_ (CLHLock *const this, unsigned mask)
+{
+	(void)mask;
+	struct LockNode_ *const node = lock_clh_node_();
+	if (node == NULL) {
+		return STATUS_NOMEM;
+	}
+	STORE(&node->locked, false, RELAXED);
+	STORE(&this->tail, node, RELAXED);
+	this->holder = this->pred = NULL;
+	return STATUS_SUCCESS;
+}
+
+// The tail node is the last released one, owned by the lock
+static inline void
+lock_clh_destroy_ (CLHLock *const this)
+{
+	struct LockNode_ *const node = LOAD(&this->tail, RELAXED);
+	assert(!LOAD(&node->locked, RELAXED));
+	free(node);
+}
+
+static inline int
+lock_clh_acquire_ (CLHLock *const this)
+{
+	struct LockNode_ *const node = lock_clh_node_();
+	if (node == NULL) {
+		return STATUS_NOMEM;
+	}
+	STORE(&node->locked, true, RELAXED);
+
+	struct LockNode_ *const pred = SWAP(&this->tail, node, ACQ_REL);
+	unsigned round = 0;
+	while (LOAD(&pred->locked, ACQUIRE)) {
+		lock_backoff_(&round);
+	}
+	this->holder = node;
+	this->pred = pred;
+	return STATUS_SUCCESS;
+}
+
+static ALWAYS inline int
+lock_clh_release_ (CLHLock *const this)
+{
+	struct LockNode_ *const pred = this->pred;
+	STORE(&this->holder->locked, false, RELEASE); // now owned by the successor
+	lock_clh_spare_(pred);
+	return STATUS_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Dispatch on the lock type
+////////////////////////////////////////////////////////////////////////
+
+// Deduce mask from lock type, and calls lock_init function
+#define lock_init(LOCK) _Generic((LOCK),             \
+        SpinLock*: lock_spin_init_,                  \
+        TicketLock*: lock_ticket_init_,              \
+        MCSLock*: lock_mcs_init_,                    \
+        CLHLock*: lock_clh_init_,                    \
+        default: lock_init)((LOCK),                  \
+    _Generic((LOCK),                                 \
+        PlainLock*: mtx_plain,                       \
+        TimedLock*: mtx_timed,                       \
+        RecursiveLock*: mtx_plain|mtx_recursive,     \
+        TimedRecursiveLock*: mtx_timed|mtx_recursive,\
+        default: 0))
+
+#define lock_destroy(LOCK) _Generic((LOCK),          \
+        SpinLock*: lock_spin_destroy_,               \
+        TicketLock*: lock_ticket_destroy_,           \
+        MCSLock*: lock_mcs_destroy_,                 \
+        CLHLock*: lock_clh_destroy_,                 \
+        default: lock_destroy)(LOCK)
+
+#define lock_acquire(LOCK) _Generic((LOCK),          \
+        SpinLock*: lock_spin_acquire_,               \
+        TicketLock*: lock_ticket_acquire_,           \
+        MCSLock*: lock_mcs_acquire_,                 \
+        CLHLock*: lock_clh_acquire_,                 \
+        default: lock_acquire)(LOCK)
+
+#define lock_release(LOCK) _Generic((LOCK),          \
+        SpinLock*: lock_spin_release_,               \
+        TicketLock*: lock_ticket_release_,           \
+        MCSLock*: lock_mcs_release_,                 \
+        CLHLock*: lock_clh_release_,                 \
+        default: lock_release)(LOCK)
+
+#define lock_try(LOCK) _Generic((LOCK),              \
+        SpinLock*: lock_spin_try_,                   \
+        TicketLock*: lock_ticket_try_,               \
+        MCSLock*: lock_mcs_try_,                     \
+        default: lock_try)(LOCK)
+
 #endif // vim:ai:sw=4:ts=4:syntax=cpp
@@ -7,11 +7,31 @@
 #ifndef POLY_MONITOR_H
 #include "MONITOR.h"
 #endif
+#include "../atomics.h"
 #include "lock.h"
+#include "profile.h"
+#ifdef __linux__
+#include "_futex.h"
+#else
 #include "condition.h"
+#endif
+#ifdef POLY_TIMER_WHEEL
+#include "../timer.h"
+#endif
 
 /*
  * An enhanced replacement for C11 type `cnd_t`.
+ *
+ * Before parking, a waiter releases the lock and spins for a while watching
+ * the signal counter `posted`: short handoffs then avoid the sleep/wakeup
+ * round-trip. The spin budget adapts to how long past waits needed, bounded
+ * by a per object limit (0 disables spinning).
+ *
+ * Waiters that must park join an intrusive FIFO queue, each one sleeping on
+ * its own futex word (or its own condition, off Linux). Signals hand the
+ * permit straight to the oldest parked waiter, and a broadcast wakes only
+ * the parked waiters, each one with its permit: nobody wakes up to find the
+ * permit taken and sleep again.
  */
 
 ////////////////////////////////////////////////////////////////////////
@@ -20,9 +40,14 @@
 
 typedef struct Notice {
 	union Lock  lock;
-	Condition   queue;
+	struct NoticeWaiter_*  head;  // parked waiters, oldest first
+	struct NoticeWaiter_** tail;
 	signed      permits; // # of threads allowed to leave the queue
-	signed      waiting; // # of threads waiting in the queue
+	signed      waiting; // # of threads waiting (spinning or parked)
+	signed      parked;  // # of threads in the queue
+	atomic(unsigned) posted; // # of signals (overflow is welcome)
+	unsigned    spin;    // current spin budget
+	unsigned    limit;   // maximum spin budget
 } Notice;
 
 static int  notice_broadcast(Notice *const this);
@@ -31,16 +56,36 @@ static int  notice_do_wait(Notice *const this);
 static int  notice_init(Notice *const this, union Lock lock);
 static int  notice_signal(Notice *const this);
 static bool notice_ready(Notice const*const this);
+static bool notice_revoke(Notice *const this);
+static void notice_spin_limit(Notice *const this, unsigned limit);
 static int  notice_wait(Notice *const this);
+static int  notice_wait_until(Notice *const this, Clock deadline);
 
 ////////////////////////////////////////////////////////////////////////
 // Notice implementation
 ////////////////////////////////////////////////////////////////////////
 
+// Spin budget bounds, in `cpu_relax` iterations
+enum { NOTICE_SPIN_MIN=16, NOTICE_SPIN_DEFAULT=2048 };
+
+// private: a parked waiter, on its own stack
+struct NoticeWaiter_ {
+	struct NoticeWaiter_* next;
+	atomic(unsigned)      word; // futex
+#ifndef __linux__
+	Condition             wake;
+#endif
+};
+
+// Parking word values
+enum { NOTICE_PARKED=0, NOTICE_GRANTED, NOTICE_ALARM };
+
 #ifdef DEBUG
 #   define ASSERT_NOTICE_INVARIANT  \
         assert(this->waiting >= 0); \
         assert(this->permits >= 0); \
+        assert(this->parked >= 0 && this->parked <= this->waiting); \
+        assert(this->spin <= this->limit); \
         assert(this->lock.mutex != NULL);
 #else
 #   define ASSERT_NOTICE_INVARIANT
@@ -49,11 +94,16 @@ static int  notice_wait(Notice *const this);
 static inline int
 notice_init (Notice *const this, union Lock lock)
 {
-	this->waiting = this->permits = 0;
+	this->waiting = this->permits = this->parked = 0;
+	this->head = NULL;
+	this->tail = &this->head;
 	this->lock = lock;
+	STORE(&this->posted, 0, RELAXED);
+	this->limit = NOTICE_SPIN_DEFAULT;
+	this->spin = NOTICE_SPIN_MIN;
 	ASSERT_NOTICE_INVARIANT
 
-	return condition_init(&this->queue);
+	return STATUS_SUCCESS;
 }
 
 static inline void
@@ -61,9 +111,9 @@ notice_destroy (Notice *const this)
 {
 	assert(this->permits == 0);
 	assert(this->waiting == 0);
+	assert(this->head == NULL);
 
 	this->lock.mutex = NULL;
-	condition_destroy(&this->queue);
 }
 
 static ALWAYS inline bool
@@ -72,16 +122,230 @@ notice_ready (Notice const*const this)
 	return this->waiting != 0;
 }
 
+// Set the spin budget limit (call with the lock held)
+static inline void
+notice_spin_limit (Notice *const this, unsigned limit)
+{
+	this->limit = limit;
+	this->spin = (limit < NOTICE_SPIN_MIN) ? limit : NOTICE_SPIN_MIN;
+	ASSERT_NOTICE_INVARIANT
+}
+
+/*
+ * Spin with the lock released until a signal is posted or the budget is
+ * exhausted. Returns true when a signal was seen (the caller rechecks the
+ * permits), false when the caller must park.
+ */
+static inline bool
+notice_spin_ (Notice *const this)
+{
+	if (this->spin == 0) {
+		return false;
+	}
+#ifdef POLY_FIBERS
+	if (fiber_current() != NULL) { // spinning would hold the OS thread
+		return false;
+	}
+#endif
+
+	unsigned const epoch = LOAD(&this->posted, RELAXED);
+	unsigned const budget = this->spin;
+	unsigned i = 0;
+
+	++this->waiting; // visible to `notice_ready` and `notice_broadcast`
+	lock_release(this->lock);
+	while (i < budget && LOAD(&this->posted, ACQUIRE) == epoch) {
+		cpu_relax();
+		++i;
+	}
+	lock_acquire(this->lock);
+	--this->waiting;
+
+	if (i < budget) { // move towards twice the observed wait
+		unsigned const goal = (2*i < this->limit) ? 2*i : this->limit;
+		this->spin += ((signed)goal - (signed)this->spin) / 8;
+	} else {   // halve the budget
+		this->spin -= this->spin / 2;
+	}
+	if (this->spin < NOTICE_SPIN_MIN) { // keep the ability to learn again
+		this->spin = (this->limit < NOTICE_SPIN_MIN) ? this->limit : NOTICE_SPIN_MIN;
+	}
+	ASSERT_NOTICE_INVARIANT
+
+	// a signal may arrive once the budget is exhausted, before relocking
+	return LOAD(&this->posted, RELAXED) != epoch;
+}
+
+#ifdef __linux__
+
+#ifdef POLY_TIMER_WHEEL
+
+// The alarm of a timed park: wakes the waiter unless already granted
+static void
+notice_alarm_ (void* argument)
+{
+	struct NoticeWaiter_ *const self = argument;
+	unsigned parked = NOTICE_PARKED;
+	if (CAS(&self->word, &parked, NOTICE_ALARM)) {
+		futex_wake(&self->word, 1);
+	}
+}
+
+#endif
+
+// Sleep while parked; spurious wakeups are filtered
+static inline int
+notice_futex_wait_ (struct NoticeWaiter_ *const self, Clock deadline)
+{
+	int err = STATUS_SUCCESS;
+	while (LOAD(&self->word, ACQUIRE) == NOTICE_PARKED) {
+		if ((err=futex_wait(&self->word, NOTICE_PARKED, deadline)) != STATUS_SUCCESS) {
+			break;
+		}
+	}
+	return err;
+}
+
+// Sleep on its own word, with the lock released
+static inline int
+notice_sleep_ (Notice *const this, struct NoticeWaiter_ *const self, Clock deadline)
+{
+	int err = STATUS_SUCCESS;
+
+#ifdef POLY_TIMER_WHEEL
+	Timer alarm;
+	TimerWheel* wheel = NULL;
+	if (deadline >= 0) {
+		wheel = timer_wheel_default();
+		timer_init(&alarm, notice_alarm_, self);
+		timer_start(wheel, &alarm, deadline, 0);
+		deadline = -1;
+	}
+#endif
+	lock_release(this->lock);
+	err = PROFILE_WAIT(this->lock.mutex, notice_futex_wait_(self, deadline));
+	lock_acquire(this->lock);
+#ifdef POLY_TIMER_WHEEL
+	if (wheel != NULL) {
+		timer_cancel(wheel, &alarm); // waits for a running alarm
+	}
+	if (err == STATUS_SUCCESS && LOAD(&self->word, ACQUIRE) == NOTICE_ALARM) {
+		err = STATUS_TIMEDOUT;
+	}
+#endif
+	return err;
+}
+
+#else
+
+// Sleep on its own condition
+static inline int
+notice_sleep_ (Notice *const this, struct NoticeWaiter_ *const self, Clock deadline)
+{
+	int err = STATUS_SUCCESS;
+	while (LOAD(&self->word, ACQUIRE) == NOTICE_PARKED) {
+		if ((err=condition_wait_until(&self->wake, this->lock, deadline)) != STATUS_SUCCESS) {
+			break;
+		}
+	}
+	return err;
+}
+
+#endif
+
+/*
+ * Park at the tail of the queue, with the lock released, until a permit is
+ * handed over. STATUS_TIMEDOUT if none is at `deadline` (negative waits
+ * forever).
+ */
+static inline int
+notice_park_ (Notice *const this, Clock deadline)
+{
+	int err;
+
+	if (deadline >= 0 && now() >= deadline) {
+		return STATUS_TIMEDOUT;
+	}
+
+	struct NoticeWaiter_ self = { .next=NULL };
+	STORE(&self.word, NOTICE_PARKED, RELAXED);
+#ifndef __linux__
+	if ((err=condition_init(&self.wake)) != STATUS_SUCCESS) {
+		return err;
+	}
+#endif
+	*this->tail = &self;
+	this->tail = &self.next;
+	++this->parked;
+	++this->waiting; // visible to `notice_ready` and `notice_broadcast`
+	ASSERT_NOTICE_INVARIANT
+
+	err = notice_sleep_(this, &self, deadline);
+#ifndef __linux__
+	condition_destroy(&self.wake);
+#endif
+
+	if (LOAD(&self.word, RELAXED) == NOTICE_GRANTED) { // dequeued by the signaler
+		ASSERT_NOTICE_INVARIANT
+		return STATUS_SUCCESS;
+	}
+
+	// timed out or failed: leave the queue (O(n), but only on timeouts)
+	struct NoticeWaiter_** link = &this->head;
+	while (*link != &self) {
+		link = &(*link)->next;
+	}
+	if ((*link=self.next) == NULL) {
+		this->tail = link;
+	}
+	--this->parked;
+	--this->waiting;
+	ASSERT_NOTICE_INVARIANT
+
+	return (err == STATUS_SUCCESS) ? STATUS_TIMEDOUT : err;
+}
+
+// Hand a permit to the oldest parked waiter (queue not empty)
+static ALWAYS inline int
+notice_grant_ (Notice *const this)
+{
+	struct NoticeWaiter_ *const waiter = this->head;
+	if ((this->head=waiter->next) == NULL) {
+		this->tail = &this->head;
+	}
+	--this->parked;
+	--this->waiting; // no longer waiting, even before it runs again
+	// the waiter needs the lock to return: its record outlives the wake
+	STORE(&waiter->word, NOTICE_GRANTED, RELEASE);
+#ifdef __linux__
+	return futex_wake(&waiter->word, 1);
+#else
+	return condition_signal(&waiter->wake);
+#endif
+}
+
 ////////////////////////////////////////////////////////////////////////
 
 static inline int
 notice_wait (Notice *const this)
 {
 	while (this->permits == 0) {
-		++this->waiting;
-		int const err = condition_wait(&this->queue, this->lock);
-		--this->waiting;
-		if (err != STATUS_SUCCESS) { return err; }
+		if (notice_spin_(this)) { continue; }
+		return notice_park_(this, -1); // the permit was handed over
+	}
+	--this->permits;
+	ASSERT_NOTICE_INVARIANT
+
+	return STATUS_SUCCESS;
+}
+
+// STATUS_TIMEDOUT if no permit is available at `deadline`
+static inline int
+notice_wait_until (Notice *const this, Clock deadline)
+{
+	while (this->permits == 0) {
+		if (notice_spin_(this)) { continue; }
+		return notice_park_(this, deadline);
 	}
 	--this->permits;
 	ASSERT_NOTICE_INVARIANT
@@ -93,10 +357,8 @@ static inline int
 notice_do_wait (Notice *const this)
 {
 	do {
-		++this->waiting;
-		int const err = condition_wait(&this->queue, this->lock);
-		--this->waiting;
-		if (err != STATUS_SUCCESS) { return err; }
+		if (notice_spin_(this)) { continue; }
+		return notice_park_(this, -1);
 	} while (this->permits == 0);
 	--this->permits;
 	ASSERT_NOTICE_INVARIANT
@@ -106,28 +368,48 @@ notice_do_wait (Notice *const this)
 
 ////////////////////////////////////////////////////////////////////////
 
+// FIFO: the oldest parked waiter gets the permit
 static ALWAYS inline int
 notice_signal (Notice *const this)
 {
-	++this->permits;
-	int const err = condition_signal(&this->queue);
-	if (err != STATUS_SUCCESS) { return err; }
+	if (this->head != NULL) {
+		return notice_grant_(this);
+	}
+	++this->permits; // for a spinner or a later waiter
+	STORE(&this->posted, LOAD(&this->posted, RELAXED)+1, RELEASE);
 	ASSERT_NOTICE_INVARIANT
 
 	return STATUS_SUCCESS;
 }
 
+// Take back a permit nobody has consumed yet
+static ALWAYS inline bool
+notice_revoke (Notice *const this)
+{
+	if (this->permits == 0) {
+		return false;
+	}
+	--this->permits;
+	ASSERT_NOTICE_INVARIANT
+
+	return true;
+}
+
+// A permit for each waiter, waking only the parked ones
 static ALWAYS inline int
 notice_broadcast (Notice *const this)
 {
-	this->permits += this->waiting;
-	if (this->permits > 0) {
-		int const err = condition_broadcast(&this->queue);
-		if (err != STATUS_SUCCESS) { return err; }
+	int err = STATUS_SUCCESS;
+
+	this->permits += this->waiting - this->parked; // spinners
+	while (this->head != NULL) {
+		int const e = notice_grant_(this);
+		if (e != STATUS_SUCCESS) { err = e; }
 	}
+	STORE(&this->posted, LOAD(&this->posted, RELAXED)+1, RELEASE);
 	ASSERT_NOTICE_INVARIANT
 
-	return STATUS_SUCCESS;
+	return err;
 }
 
 #undef ASSERT_NOTICE_INVARIANT
@@ -0,0 +1,361 @@
+#ifndef POLY_PROFILE_H
+#define POLY_PROFILE_H
+
+#ifndef POLY_H
+#include "../POLY.h"
+#endif
+
+/*
+ * Monitor contention profiler, compiled in only if `POLY_PROFILE` is
+ * defined (otherwise the API below does nothing and monitors are
+ * untouched).
+ *
+ * Each monitor entry records, per lock, the number of acquires, how many
+ * found the lock taken, and log2 histograms of the time waited for the lock
+ * and the time it was held (minus condition waits); condition waits are
+ * counted against the lock they release. Samples go to a per thread table
+ * without synchronization; `profile_dump` merges the tables of all threads.
+ * With `POLY_FIBERS` each fiber keeps its own condition wait total (saved
+ * at switches, as `Thread_ID`), and samples go to the table of the thread
+ * releasing the lock, since a fiber can move between threads while inside
+ * a monitor.
+ * Times are taken with `timestamp()` (see clock.h) and converted to
+ * nanoseconds only in the dumps.
+ *
+ * Locks are identified by address: the address of the monitor object for
+ * all POLY monitors, whose lock is the first field.
+ */
+
+////////////////////////////////////////////////////////////////////////
+// Profile interface
+////////////////////////////////////////////////////////////////////////
+
+#ifndef POLY_PROFILE
+
+#define profile_name(OBJECT,NAME)   ((void)(OBJECT), (void)(NAME))
+#define profile_dump(FILE)          ((void)(FILE))
+#define profile_reset()             ((void)0)
+
+#define PROFILE_WAIT(LOCK,CALL)     (CALL)
+
+#else
+
+#include <stdint.h>
+#include <stdio.h>
+#include "../atomics.h"
+#include "../clock.h"
+
+//#include <stdlib.h>
+extern void* calloc(size_t, size_t);
+extern void* malloc(size_t);
+
+static void profile_name(void const* object, char const* name);
+static void profile_dump(FILE* output);
+static void profile_reset(void);
+
+////////////////////////////////////////////////////////////////////////
+// Profile implementation
+////////////////////////////////////////////////////////////////////////
+
+#ifndef POLY_PROFILE_LOCKS
+#define POLY_PROFILE_LOCKS 256 // locks tracked by each thread
+#endif
+
+enum { PROFILE_BUCKETS=32 }; // [2^(i-1), 2^i) ticks; the last one is open
+
+static_assert((POLY_PROFILE_LOCKS & (POLY_PROFILE_LOCKS-1)) == 0);
+
+// private: samples of one lock in one thread (written by its thread only)
+struct ProfileRecord_ {
+	atomic(void const*)     lock;
+	atomic(unsigned long)   acquires;
+	atomic(unsigned long)   contended;
+	atomic(unsigned long)   waits;     // on conditions
+	atomic(unsigned long)   wait[PROFILE_BUCKETS];
+	atomic(unsigned long)   hold[PROFILE_BUCKETS];
+	atomic(Ticks)           waited;    // total ticks waiting for the lock
+	atomic(Ticks)           held;      // total ticks holding the lock
+};
+
+struct ProfileTable_ {
+	struct ProfileTable_*   next;
+	atomic(unsigned long)   dropped;   // samples of locks not fitting
+	struct ProfileRecord_   record[POLY_PROFILE_LOCKS];
+};
+
+struct ProfileName_ {
+	struct ProfileName_*    next;
+	void const*             object;
+	char const*             name;
+};
+
+// Tables and names of all threads (tables outlive their threads)
+static struct {
+	mtx_t                   lock;
+	struct ProfileTable_*   tables;
+	struct ProfileName_*    names;
+} PROFILE_;
+
+static once_flag PROFILE_ONCE_ = ONCE_FLAG_INIT;
+static _Thread_local struct ProfileTable_* PROFILE_TABLE_ = NULL;
+static _Thread_local Ticks PROFILE_WAITED_ = 0; // on conditions, by this thread or fiber
+
+// private: one monitor entry in progress
+struct ProfileEntry_ {
+	void const*             lock;
+	Ticks                   start;
+	Ticks                   acquired;
+	Ticks                   waited;    // PROFILE_WAITED_ on acquire
+	bool                    contended;
+};
+
+static void
+profile_init_ (void)
+{
+	if (mtx_init(&PROFILE_.lock, mtx_plain) != STATUS_SUCCESS) {
+		panic("cannot initialize the profiler");
+	}
+}
+
+// Add to a counter of this thread
+static ALWAYS inline void
+profile_add_ (atomic(unsigned long)* counter, unsigned long n)
+{
+	STORE(counter, LOAD(counter, RELAXED)+n, RELAXED);
+}
+
+static ALWAYS inline unsigned
+profile_bucket_ (Ticks t)
+{
+	unsigned const b = (t == 0) ? 0 : 64 - __builtin_clzll(t);
+	return (b < PROFILE_BUCKETS) ? b : PROFILE_BUCKETS-1;
+}
+
+// Ticks from `t0` to `t1`, 0 if the counters of two cores disagree
+static ALWAYS inline Ticks
+profile_elapsed_ (Ticks t0, Ticks t1)
+{
+	return (t1 > t0) ? t1 - t0 : 0;
+}
+
+static struct ProfileRecord_*
+profile_record_ (void const* lock)
+{
+	struct ProfileTable_* table = PROFILE_TABLE_;
+	if (table == NULL) {
+		if ((table=calloc(1, sizeof(struct ProfileTable_))) == NULL) {
+			return NULL;
+		}
+		call_once(&PROFILE_ONCE_, profile_init_);
+		mtx_lock(&PROFILE_.lock);
+		table->next = PROFILE_.tables;
+		PROFILE_.tables = table;
+		mtx_unlock(&PROFILE_.lock);
+		PROFILE_TABLE_ = table;
+	}
+	unsigned const mask = POLY_PROFILE_LOCKS-1;
+	unsigned i = ((uintptr_t)lock >> 4) * 2654435761u & mask;
+	for (unsigned n = 0; n <= mask; ++n, i = (i+1) & mask) {
+		struct ProfileRecord_ *const record = &table->record[i];
+		void const *const owner = LOAD(&record->lock, RELAXED);
+		if (owner == lock) {
+			return record;
+		}
+		if (owner == NULL) {
+			STORE(&record->lock, lock, RELEASE);
+			return record;
+		}
+	}
+	profile_add_(&table->dropped, 1);
+	return NULL;
+}
+
+static ALWAYS inline void
+profile_begin_ (struct ProfileEntry_* entry, void const* lock)
+{
+	entry->lock = lock;
+	entry->contended = false;
+	entry->start = timestamp();
+}
+
+static ALWAYS inline void
+profile_acquired_ (struct ProfileEntry_* entry)
+{
+	entry->acquired = timestamp();
+	entry->waited = PROFILE_WAITED_;
+}
+
+static inline void
+profile_released_ (struct ProfileEntry_* entry)
+{
+	struct ProfileRecord_ *const record = profile_record_(entry->lock);
+	if (record == NULL) {
+		return;
+	}
+	Ticks const wait = profile_elapsed_(entry->start, entry->acquired);
+	Ticks const hold = profile_elapsed_(entry->acquired + (PROFILE_WAITED_ - entry->waited), timestamp());
+
+	profile_add_(&record->acquires, 1);
+	if (entry->contended) {
+		profile_add_(&record->contended, 1);
+	}
+	profile_add_(&record->wait[profile_bucket_(wait)], 1);
+	profile_add_(&record->hold[profile_bucket_(hold)], 1);
+	STORE(&record->waited, LOAD(&record->waited, RELAXED)+wait, RELAXED);
+	STORE(&record->held, LOAD(&record->held, RELAXED)+hold, RELAXED);
+}
+
+// A condition wait on `lock`, started at `start`
+static inline void
+profile_waited_ (void const* lock, Ticks start)
+{
+	PROFILE_WAITED_ += profile_elapsed_(start, timestamp());
+	struct ProfileRecord_ *const record = profile_record_(lock);
+	if (record != NULL) {
+		profile_add_(&record->waits, 1);
+	}
+}
+
+#define PROFILE_WAIT(LOCK,CALL) ({              \
+    Ticks const profile_start_ = timestamp();   \
+    int const profile_err_ = (CALL);            \
+    profile_waited_((LOCK), profile_start_);    \
+    profile_err_;                               \
+})
+
+////////////////////////////////////////////////////////////////////////
+
+// Label `object` in the dumps; `name` must outlive the profiling
+static inline void
+profile_name (void const* object, char const* name)
+{
+	call_once(&PROFILE_ONCE_, profile_init_);
+	mtx_lock(&PROFILE_.lock);
+	struct ProfileName_* n;
+	for (n = PROFILE_.names; n != NULL && n->object != object; n = n->next) {
+		/*empty*/;
+	}
+	if (n == NULL && (n=malloc(sizeof(struct ProfileName_))) != NULL) {
+		n->object = object;
+		n->next = PROFILE_.names;
+		PROFILE_.names = n;
+	}
+	if (n != NULL) {
+		n->name = name;
+	}
+	mtx_unlock(&PROFILE_.lock);
+}
+
+// Upper bound of the bucket holding the `q` quantile, in nanoseconds
+static Clock
+profile_quantile_ (unsigned long const histogram[PROFILE_BUCKETS], unsigned long total, double q)
+{
+	if (total == 0) {
+		return 0;
+	}
+	unsigned long const rank = (unsigned long)(q * total);
+	unsigned long seen = 0;
+	for (unsigned b = 0; b < PROFILE_BUCKETS; ++b) {
+		if ((seen += histogram[b]) > rank) {
+			return ticks2ns((Ticks)1 << b);
+		}
+	}
+	return ticks2ns((Ticks)1 << (PROFILE_BUCKETS-1));
+}
+
+/*
+ * One line per lock, merging all threads: acquires, contended acquires,
+ * condition waits, and mean, median and 99th percentile (bucket upper
+ * bounds) of the wait and hold times, in nanoseconds.
+ */
+static inline void
+profile_dump (FILE* output)
+{
+	call_once(&PROFILE_ONCE_, profile_init_);
+	mtx_lock(&PROFILE_.lock);
+
+	fprintf(output, "%-18s %-16s %10s %10s %8s %10s %10s %10s %10s %10s %10s\n",
+	        "lock", "name", "acquires", "contended", "waits",
+	        "wait-mean", "wait-p50", "wait-p99", "hold-mean", "hold-p50", "hold-p99");
+	unsigned long dropped = 0;
+	for (struct ProfileTable_* t = PROFILE_.tables; t != NULL; t = t->next) {
+		dropped += LOAD(&t->dropped, RELAXED);
+		for (unsigned i = 0; i < POLY_PROFILE_LOCKS; ++i) {
+			void const *const lock = LOAD(&t->record[i].lock, ACQUIRE);
+			if (lock == NULL) {
+				continue;
+			}
+			// report each lock once: at its first record in table order
+			bool seen = false;
+			for (struct ProfileTable_* u = PROFILE_.tables; u != t && !seen; u = u->next) {
+				for (unsigned j = 0; j < POLY_PROFILE_LOCKS && !seen; ++j) {
+					seen = (LOAD(&u->record[j].lock, RELAXED) == lock);
+				}
+			}
+			if (seen) {
+				continue;
+			}
+			unsigned long acquires = 0, contended = 0, waits = 0;
+			unsigned long wait[PROFILE_BUCKETS] = {0}, hold[PROFILE_BUCKETS] = {0};
+			Ticks waited = 0, held = 0;
+			for (struct ProfileTable_* u = t; u != NULL; u = u->next) {
+				for (unsigned j = 0; j < POLY_PROFILE_LOCKS; ++j) {
+					struct ProfileRecord_ *const r = &u->record[j];
+					if (LOAD(&r->lock, RELAXED) != lock) {
+						continue;
+					}
+					acquires += LOAD(&r->acquires, RELAXED);
+					contended += LOAD(&r->contended, RELAXED);
+					waits += LOAD(&r->waits, RELAXED);
+					waited += LOAD(&r->waited, RELAXED);
+					held += LOAD(&r->held, RELAXED);
+					for (unsigned b = 0; b < PROFILE_BUCKETS; ++b) {
+						wait[b] += LOAD(&r->wait[b], RELAXED);
+						hold[b] += LOAD(&r->hold[b], RELAXED);
+					}
+				}
+			}
+			char const* name = "";
+			for (struct ProfileName_* n = PROFILE_.names; n != NULL; n = n->next) {
+				if (n->object == lock) { name = n->name; break; }
+			}
+			unsigned long const n = acquires ? acquires : 1;
+			fprintf(output, "%-18p %-16s %10lu %10lu %8lu %10lld %10lld %10lld %10lld %10lld %10lld\n",
+			        lock, name, acquires, contended, waits,
+			        ticks2ns(waited/n), profile_quantile_(wait, acquires, 0.5), profile_quantile_(wait, acquires, 0.99),
+			        ticks2ns(held/n), profile_quantile_(hold, acquires, 0.5), profile_quantile_(hold, acquires, 0.99));
+		}
+	}
+	if (dropped > 0) {
+		fprintf(output, "(%lu samples of untracked locks: raise POLY_PROFILE_LOCKS)\n", dropped);
+	}
+	mtx_unlock(&PROFILE_.lock);
+}
+
+// Forget the samples (not the names); call with the profiled threads idle
+static inline void
+profile_reset (void)
+{
+	call_once(&PROFILE_ONCE_, profile_init_);
+	mtx_lock(&PROFILE_.lock);
+	for (struct ProfileTable_* t = PROFILE_.tables; t != NULL; t = t->next) {
+		STORE(&t->dropped, 0, RELAXED);
+		for (unsigned i = 0; i < POLY_PROFILE_LOCKS; ++i) {
+			struct ProfileRecord_ *const r = &t->record[i];
+			STORE(&r->acquires, 0, RELAXED);
+			STORE(&r->contended, 0, RELAXED);
+			STORE(&r->waits, 0, RELAXED);
+			STORE(&r->waited, 0, RELAXED);
+			STORE(&r->held, 0, RELAXED);
+			for (unsigned b = 0; b < PROFILE_BUCKETS; ++b) {
+				STORE(&r->wait[b], 0, RELAXED);
+				STORE(&r->hold[b], 0, RELAXED);
+			}
+		}
+	}
+	mtx_unlock(&PROFILE_.lock);
+}
+
+#endif
+
+#endif // vim:ai:sw=4:ts=4:syntax=cpp
@@ -0,0 +1,309 @@
+#ifndef POLY_PARALLEL_H
+#define POLY_PARALLEL_H
+
+#ifndef POLY_H
+#include "POLY.h"
+#endif
+#include "atomics.h"
+#include "scalar.h"
+#include "executor.h"
+#include "forkjoin.h"
+
+#include <alloca.h>
+
+/*
+ * Data parallel loops over index ranges and `Scalar` arrays, run by the
+ * workers of an executor plus the calling thread. Ranges are split into
+ * chunks, taken from a shared counter:
+ *
+ * - PARALLEL_STATIC: one even chunk per participant (at least `grain`
+ *   indexes each).
+ * - PARALLEL_DYNAMIC: chunks of `grain` indexes, taken on demand; for
+ *   uneven work.
+ *
+ * Loops allocate no memory: their state lives in the caller frame. Called
+ * from a worker the caller helps with other jobs while waiting, as in
+ * `join_sync`.
+ */
+
+////////////////////////////////////////////////////////////////////////
+// Parallel interface
+////////////////////////////////////////////////////////////////////////
+
+enum ParallelSchedule {
+	PARALLEL_STATIC,
+	PARALLEL_DYNAMIC,
+};
+
+typedef struct Parallel {
+	Executor*   executor; // NULL runs loops in the caller
+	unsigned    schedule; // PARALLEL_STATIC or PARALLEL_DYNAMIC
+	size_t      grain;    // least indexes per chunk; 0 for automatic
+} Parallel;
+
+static void   parallel_for(Parallel const*const this, size_t begin, size_t end, void body(size_t begin, size_t end));
+static Scalar parallel_reduce(Parallel const*const this, size_t begin, size_t end, Scalar identity, Scalar body(size_t begin, size_t end), Scalar combine(Scalar lhs, Scalar rhs));
+static void   parallel_scan(Parallel const*const this, size_t n, Scalar array[n], Scalar combine(Scalar lhs, Scalar rhs));
+
+/*
+ *  Parallel p = { .executor=&e, .schedule=PARALLEL_DYNAMIC, .grain=4096 };
+ *
+ *  inline void scale(size_t i, size_t n) {
+ *      for (; i < n; ++i) { a[i].d *= 2; }
+ *  }
+ *  parallel_for(&p, 0, N, scale);
+ *
+ *  inline Scalar sum(size_t i, size_t n) {
+ *      Double s = 0;
+ *      for (; i < n; ++i) { s += a[i].d; }
+ *      return Double(s);
+ *  }
+ *  inline Scalar add(Scalar x, Scalar y) { return (Scalar){.d=x.d+y.d}; }
+ *  Scalar total = parallel_reduce(&p, 0, N, Double(0), sum, add);
+ *
+ *  parallel_scan(&p, N, a, add); // a[i] = a[0] + ... + a[i]
+ */
+
+////////////////////////////////////////////////////////////////////////
+// Parallel implementation
+////////////////////////////////////////////////////////////////////////
+
+enum { PARALLEL_CHUNKS=8 }; // automatic grain: chunks per participant
+
+// private: a loop shared by its participants
+struct ParallelLoop_ {
+	size_t             begin;
+	size_t             end;
+	size_t             chunk;        // indexes per chunk
+	size_t             chunks;
+	unsigned           participants; // upper bound
+	atomic(size_t)     next;         // next chunk to run
+	atomic(unsigned)   arrived;      // gives participant numbers
+	void             (*run)(void* context, unsigned participant, size_t chunk, size_t begin, size_t end);
+	void*              context;      // of `run`, in the caller frame
+};
+
+// private: a partial result, alone in its cache line
+struct ParallelSlot_ {
+	CACHE_ALIGNED
+	Scalar value;
+};
+
+static inline void
+parallel_plan_ (Parallel const*const this, unsigned schedule, size_t begin, size_t end, struct ParallelLoop_* loop)
+{
+	assert(begin <= end);
+
+	unsigned participants = 1;
+	if (this->executor != NULL) {
+		Worker *const self = EXECUTOR_WORKER_;
+		bool const inside = (self != NULL && self->executor == this->executor);
+		participants = executor_size(this->executor) + (inside ? 0 : 1);
+	}
+	size_t const n = end - begin;
+	size_t chunk;
+	if (schedule == PARALLEL_DYNAMIC) {
+		chunk = (this->grain != 0) ? this->grain : (n + PARALLEL_CHUNKS*participants-1) / (PARALLEL_CHUNKS*participants);
+	} else {
+		chunk = (n + participants-1) / participants;
+		if (chunk < this->grain) { chunk = this->grain; }
+	}
+	if (chunk == 0) { chunk = 1; }
+
+	loop->begin = begin;
+	loop->end = end;
+	loop->chunk = chunk;
+	loop->chunks = (n + chunk-1) / chunk;
+	loop->participants = (loop->chunks < participants) ? loop->chunks : participants;
+	STORE(&loop->next, 0, RELAXED);
+	STORE(&loop->arrived, 0, RELAXED);
+}
+
+// Run chunks until none is left
+static inline void
+parallel_participate_ (struct ParallelLoop_* loop)
+{
+	unsigned const participant = reg_add(&loop->arrived, 1, RELAXED);
+	size_t c;
+
+	while ((c=reg_add(&loop->next, 1, RELAXED)) < loop->chunks) {
+		size_t const lo = loop->begin + c*loop->chunk;
+		size_t const hi = (loop->end - lo > loop->chunk) ? lo + loop->chunk : loop->end;
+		loop->run(loop->context, participant, c, lo, hi);
+	}
+}
+
+static int
+parallel_helper_ (void* data)
+{
+	parallel_participate_(*(struct ParallelLoop_**)data);
+	return STATUS_SUCCESS;
+}
+
+// Queue the helpers, participate, and wait for the helpers to finish
+static void
+parallel_run_ (Parallel const*const this, struct ParallelLoop_* loop)
+{
+	Join join;
+	join_init(&join);
+
+	for (unsigned i = 1; i < loop->participants; ++i) {
+		Job *const job = alloca(sizeof(Job) + sizeof(struct ParallelLoop_*));
+		*(struct ParallelLoop_**)job->data = loop;
+		job->next = NULL;
+		job->main = parallel_helper_;
+		job->join = &join.count;
+		reg_add(&join.count, 1, RELAXED);
+		executor_push_(this->executor, job);
+	}
+	parallel_participate_(loop);
+	join_sync(&join);
+}
+
+////////////////////////////////////////////////////////////////////////
+
+/*
+ * The chunk runners are plain functions with their state in a context
+ * record: taking the address of a nested function would need a trampoline
+ * on an executable stack.
+ */
+
+struct ParallelFor_ {
+	void      (*body)(size_t begin, size_t end);
+};
+
+static void
+parallel_for_run_ (void* context, unsigned participant, size_t chunk, size_t lo, size_t hi)
+{
+	struct ParallelFor_ const*const this = context;
+	(void)participant; (void)chunk;
+	this->body(lo, hi);
+}
+
+static void
+parallel_for (Parallel const*const this, size_t begin, size_t end, void body(size_t begin, size_t end))
+{
+	struct ParallelLoop_ loop;
+	struct ParallelFor_ context = { .body=body };
+
+	parallel_plan_(this, this->schedule, begin, end, &loop);
+	loop.run = parallel_for_run_;
+	loop.context = &context;
+	parallel_run_(this, &loop);
+}
+
+struct ParallelReduce_ {
+	bool                  ordered;
+	struct ParallelSlot_* partial;
+	Scalar              (*body)(size_t begin, size_t end);
+	Scalar              (*combine)(Scalar lhs, Scalar rhs);
+};
+
+static void
+parallel_reduce_run_ (void* context, unsigned participant, size_t chunk, size_t lo, size_t hi)
+{
+	struct ParallelReduce_ const*const this = context;
+	unsigned const i = this->ordered ? chunk : participant;
+	this->partial[i].value = this->combine(this->partial[i].value, this->body(lo, hi));
+}
+
+/*
+ * `combine` must be associative, and also commutative for PARALLEL_DYNAMIC
+ * loops; `identity` is its neutral element.
+ */
+static Scalar
+parallel_reduce (Parallel const*const this, size_t begin, size_t end, Scalar identity, Scalar body(size_t begin, size_t end), Scalar combine(Scalar lhs, Scalar rhs))
+{
+	struct ParallelLoop_ loop;
+	parallel_plan_(this, this->schedule, begin, end, &loop);
+
+	// static: one slot per chunk, in order; dynamic: one slot per participant
+	bool const ordered = (this->schedule != PARALLEL_DYNAMIC);
+	unsigned const slots = ordered ? loop.chunks : loop.participants;
+	struct ParallelSlot_ partial[slots ? slots : 1];
+	for (unsigned i = 0; i < slots; ++i) {
+		partial[i].value = identity;
+	}
+
+	struct ParallelReduce_ context = {
+		.ordered=ordered, .partial=partial, .body=body, .combine=combine
+	};
+	loop.run = parallel_reduce_run_;
+	loop.context = &context;
+	parallel_run_(this, &loop);
+
+	Scalar result = identity;
+	for (unsigned i = 0; i < slots; ++i) {
+		result = combine(result, partial[i].value);
+	}
+	return result;
+}
+
+struct ParallelScan_ {
+	size_t                chunks;
+	Scalar*               array;
+	struct ParallelSlot_* carry;
+	Scalar              (*combine)(Scalar lhs, Scalar rhs);
+};
+
+// pass 1: chunk totals (but the last)
+static void
+parallel_scan_total_ (void* context, unsigned participant, size_t chunk, size_t lo, size_t hi)
+{
+	struct ParallelScan_ const*const this = context;
+	(void)participant;
+	if (chunk+1 == this->chunks) { return; }
+	Scalar s = this->array[lo];
+	for (size_t i = lo+1; i < hi; ++i) {
+		s = this->combine(s, this->array[i]);
+	}
+	this->carry[chunk].value = s;
+}
+
+// pass 2: prefix of each chunk, starting with the totals before it
+static void
+parallel_scan_prefix_ (void* context, unsigned participant, size_t chunk, size_t lo, size_t hi)
+{
+	struct ParallelScan_ const*const this = context;
+	Scalar *const array = this->array;
+	(void)participant;
+	Scalar s = (chunk == 0) ? array[lo] : this->combine(this->carry[chunk-1].value, array[lo]);
+	array[lo] = s;
+	for (size_t i = lo+1; i < hi; ++i) {
+		array[i] = s = this->combine(s, array[i]);
+	}
+}
+
+/*
+ * Inclusive prefix in place: `array[i] = array[0] + ... + array[i]`, with
+ * an associative `combine`. Always static: the chunk totals are combined
+ * by the caller between two parallel passes.
+ */
+static void
+parallel_scan (Parallel const*const this, size_t n, Scalar array[n], Scalar combine(Scalar lhs, Scalar rhs))
+{
+	struct ParallelLoop_ loop;
+	parallel_plan_(this, PARALLEL_STATIC, 0, n, &loop);
+	if (loop.chunks == 0) {
+		return;
+	}
+	struct ParallelSlot_ carry[loop.chunks];
+	struct ParallelScan_ context = {
+		.chunks=loop.chunks, .array=array, .carry=carry, .combine=combine
+	};
+	loop.context = &context;
+
+	if (loop.chunks > 1) {
+		loop.run = parallel_scan_total_;
+		parallel_run_(this, &loop);
+		for (size_t c = 1; c+1 < loop.chunks; ++c) { // carry[c] = totals of 0..c
+			carry[c].value = combine(carry[c-1].value, carry[c].value);
+		}
+		STORE(&loop.next, 0, RELAXED);
+		STORE(&loop.arrived, 0, RELAXED);
+	}
+	loop.run = parallel_scan_prefix_;
+	parallel_run_(this, &loop);
+}
+
+#endif // vim:ai:sw=4:ts=4:syntax=cpp
@@ -0,0 +1,125 @@
+#ifndef POLY_CFIFO_H
+#define POLY_CFIFO_H
+
+#ifndef POLY_H
+#include "../POLY.h"
+#endif
+#include "../atomics.h"
+#include "../scalar.h"
+#include "../monitor/combiner.h"
+#include "_fifo.h"
+
+/*
+ * Bounded FIFO of Scalars shared by any number of producers and consumers
+ * through flat combining: a single thread at a time runs the batch of
+ * pending puts and gets on a plain FIFO. The count is mirrored in an
+ * atomic so `empty` and `full` can be checked without combining.
+ */
+
+////////////////////////////////////////////////////////////////////////
+// CFIFO interface (combining buffer of Scalars)
+////////////////////////////////////////////////////////////////////////
+
+typedef struct CFIFO {
+	Combiner         combiner;
+	FIFO             queue;
+	CACHE_ALIGNED
+	atomic(unsigned) count;   // written by the combiner
+} CFIFO;
+
+static int      cfifo_init(CFIFO *const this, unsigned capacity);
+static void     cfifo_destroy(CFIFO *const this);
+static bool     cfifo_empty(CFIFO const*const this);
+static bool     cfifo_full(CFIFO const*const this);
+static bool     cfifo_put(CFIFO *const this, Scalar scalar);
+static bool     cfifo_get(CFIFO *const this, Scalar scalar[static 1]);
+
+////////////////////////////////////////////////////////////////////////
+// CFIFO implementation
+////////////////////////////////////////////////////////////////////////
+
+static int
+cfifo_init (CFIFO *const this, unsigned capacity)
+{
+	int err;
+
+	STORE(&this->count, 0, RELAXED);
+	catch (fifo_init(&this->queue, capacity));
+	if ((err=combiner_init(&this->combiner)) != STATUS_SUCCESS) {
+		fifo_destroy(&this->queue);
+		goto onerror;
+	}
+	return STATUS_SUCCESS;
+onerror:
+	return err;
+}
+
+static void
+cfifo_destroy (CFIFO *const this)
+{
+	combiner_destroy(&this->combiner);
+	fifo_destroy(&this->queue);
+}
+
+static ALWAYS inline bool
+cfifo_empty (CFIFO const*const this)
+{
+	return LOAD(&this->count, ACQUIRE) == 0;
+}
+
+static ALWAYS inline bool
+cfifo_full (CFIFO const*const this)
+{
+	return LOAD(&this->count, ACQUIRE) == this->queue.capacity;
+}
+
+// private: a put or get request
+struct CFIFOOperation_ {
+	CFIFO*  fifo;
+	Scalar* scalar;
+	bool    done;
+};
+
+static void
+cfifo_put_ (void* data)
+{
+	struct CFIFOOperation_ *const op = data;
+	CFIFO *const this = op->fifo;
+
+	if ((op->done=!fifo_full(&this->queue))) {
+		fifo_put(&this->queue, *op->scalar);
+		STORE(&this->count, fifo_count(&this->queue), RELEASE);
+	}
+}
+
+static void
+cfifo_get_ (void* data)
+{
+	struct CFIFOOperation_ *const op = data;
+	CFIFO *const this = op->fifo;
+
+	if ((op->done=!fifo_empty(&this->queue))) {
+		*op->scalar = fifo_get(&this->queue);
+		STORE(&this->count, fifo_count(&this->queue), RELEASE);
+	}
+}
+
+// False if full
+static ALWAYS inline bool
+cfifo_put (CFIFO *const this, Scalar scalar)
+{
+	struct CFIFOOperation_ op = { .fifo=this, .scalar=&scalar };
+	combiner_execute(&this->combiner, cfifo_put_, &op);
+	return op.done;
+}
+
+// False if empty
+static ALWAYS inline bool
+cfifo_get (CFIFO *const this, Scalar scalar[static 1])
+{
+	struct CFIFOOperation_ op = { .fifo=this, .scalar=scalar };
+	combiner_execute(&this->combiner, cfifo_get_, &op);
+	return op.done;
+}
+
+#endif // vim:ai:sw=4:ts=4:syntax=cpp
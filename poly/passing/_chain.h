@@ -0,0 +1,245 @@
+#ifndef POLY_CHAIN_H
+#define POLY_CHAIN_H
+
+#ifndef POLY_H
+#include "../POLY.h"
+#endif
+#include "../scalar.h"
+
+//#include <stdlib.h>
+extern void  free(void*);
+extern void* malloc(size_t);
+//#include <string.h>
+extern void* memcpy(void*, void const*, size_t);
+
+/*
+ * Unbounded queue of Scalars for callers that provide their own mutual
+ * exclusion. Scalars are stored in a linked list of fixed size segments;
+ * drained segments are kept in a short free list for reuse, and the rest
+ * are returned to the allocator, so memory follows the actual occupation.
+ */
+
+////////////////////////////////////////////////////////////////////////
+// Chain interface (list of segments of Scalars)
+////////////////////////////////////////////////////////////////////////
+
+#ifndef POLY_CHAIN_SEGMENT
+#define POLY_CHAIN_SEGMENT  126 // Scalars per segment (~1KiB with the link)
+#endif
+#ifndef POLY_CHAIN_SPARES
+#define POLY_CHAIN_SPARES   4   // max. # of segments kept for reuse
+#endif
+
+struct ChainSegment {
+	struct ChainSegment* next;
+	Scalar               slot[POLY_CHAIN_SEGMENT];
+};
+
+typedef struct Chain {
+	struct ChainSegment* head;  // oldest segment, read from
+	struct ChainSegment* tail;  // newest segment, written to
+	struct ChainSegment* spare; // free list
+	unsigned             read;  // next slot to read in `head`
+	unsigned             write; // next slot to write in `tail`
+	unsigned             count;
+	unsigned             spares; // # of segments in the free list
+} Chain;
+
+static int      chain_init(Chain *const this);
+static void     chain_destroy(Chain *const this);
+static unsigned chain_count(Chain const*const this);
+static bool     chain_empty(Chain const*const this);
+static int      chain_put(Chain *const this, Scalar scalar);
+static Scalar   chain_get(Chain *const this);
+static unsigned chain_put_n(Chain *const this, Scalar const source[], unsigned n);
+static unsigned chain_get_n(Chain *const this, Scalar target[], unsigned n);
+
+////////////////////////////////////////////////////////////////////////
+// Chain implementation
+////////////////////////////////////////////////////////////////////////
+
+#ifdef DEBUG
+#   define ASSERT_CHAIN_INVARIANT                              \
+        assert(this->spares <= POLY_CHAIN_SPARES);             \
+        assert(this->read <= POLY_CHAIN_SEGMENT);              \
+        assert(this->write <= POLY_CHAIN_SEGMENT);             \
+        assert((this->head == NULL) == (this->tail == NULL));  \
+        assert(this->head != NULL || this->count == 0);
+#else
+#   define ASSERT_CHAIN_INVARIANT
+#endif
+
+static inline int
+chain_init (Chain *const this)
+{
+	this->head = this->tail = this->spare = NULL;
+	this->read = this->write = 0;
+	this->count = this->spares = 0;
+	ASSERT_CHAIN_INVARIANT
+
+	return STATUS_SUCCESS;
+}
+
+static void
+chain_destroy (Chain *const this)
+{
+	struct ChainSegment* lists[2] = { this->head, this->spare };
+
+	for (unsigned i = 0; i < 2; ++i) {
+		struct ChainSegment* segment = lists[i];
+		while (segment != NULL) {
+			struct ChainSegment *const next = segment->next;
+			free(segment);
+			segment = next;
+		}
+	}
+	this->head = this->tail = this->spare = NULL;
+}
+
+static ALWAYS inline unsigned
+chain_count (Chain const*const this)
+{
+	return this->count;
+}
+
+static ALWAYS inline bool
+chain_empty (Chain const*const this)
+{
+	return this->count == 0;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+// Append an empty segment, reusing a spare one if possible
+static inline bool
+chain_grow_ (Chain *const this)
+{
+	struct ChainSegment* segment = this->spare;
+
+	if (segment != NULL) {
+		this->spare = segment->next;
+		--this->spares;
+	} else if ((segment = malloc(sizeof(struct ChainSegment))) == NULL) {
+		return false;
+	}
+	segment->next = NULL;
+
+	if (this->tail == NULL) {
+		this->head = segment;
+		this->read = 0;
+	} else {
+		this->tail->next = segment;
+	}
+	this->tail = segment;
+	this->write = 0;
+
+	return true;
+}
+
+// Drop the drained `head` segment, keeping it as spare if there is room
+static inline void
+chain_shrink_ (Chain *const this)
+{
+	struct ChainSegment *const segment = this->head;
+
+	this->head = segment->next;
+	this->read = 0;
+	if (this->head == NULL) {
+		this->tail = NULL;
+		this->write = 0;
+	}
+
+	if (this->spares < POLY_CHAIN_SPARES) {
+		segment->next = this->spare;
+		this->spare = segment;
+		++this->spares;
+	} else {
+		free(segment);
+	}
+}
+
+// STATUS_NOMEM if a new segment is needed and cannot be allocated
+static inline int
+chain_put (Chain *const this, Scalar scalar)
+{
+	if (this->tail == NULL || this->write == POLY_CHAIN_SEGMENT) {
+		if (!chain_grow_(this)) {
+			return STATUS_NOMEM;
+		}
+	}
+	this->tail->slot[this->write++] = scalar;
+	++this->count;
+	ASSERT_CHAIN_INVARIANT
+
+	return STATUS_SUCCESS;
+}
+
+static inline Scalar
+chain_get (Chain *const this)
+{
+	assert(!chain_empty(this));
+
+	Scalar const scalar = this->head->slot[this->read++];
+	--this->count;
+	if (this->read == POLY_CHAIN_SEGMENT || this->count == 0) {
+		chain_shrink_(this);
+	}
+	ASSERT_CHAIN_INVARIANT
+
+	return scalar;
+}
+
+/*
+ * Bulk transfers copy segment by segment and return how many Scalars were
+ * moved; `chain_put_n` moves less than `n` only when out of memory.
+ */
+
+static inline unsigned
+chain_put_n (Chain *const this, Scalar const source[], unsigned n)
+{
+	unsigned done = 0;
+
+	while (done < n) {
+		if (this->tail == NULL || this->write == POLY_CHAIN_SEGMENT) {
+			if (!chain_grow_(this)) {
+				break;
+			}
+		}
+		unsigned k = POLY_CHAIN_SEGMENT - this->write;
+		if (k > n - done) { k = n - done; }
+		memcpy(&this->tail->slot[this->write], source+done, k*sizeof(Scalar));
+		this->write += k;
+		this->count += k;
+		done += k;
+	}
+	ASSERT_CHAIN_INVARIANT
+
+	return done;
+}
+
+static inline unsigned
+chain_get_n (Chain *const this, Scalar target[], unsigned n)
+{
+	if (n > this->count) { n = this->count; }
+	unsigned done = 0;
+
+	while (done < n) {
+		unsigned const end = (this->head == this->tail) ? this->write : POLY_CHAIN_SEGMENT;
+		unsigned k = end - this->read;
+		if (k > n - done) { k = n - done; }
+		memcpy(target+done, &this->head->slot[this->read], k*sizeof(Scalar));
+		this->read += k;
+		this->count -= k;
+		done += k;
+		if (this->read == POLY_CHAIN_SEGMENT || this->count == 0) {
+			chain_shrink_(this);
+		}
+	}
+	ASSERT_CHAIN_INVARIANT
+
+	return n;
+}
+
+#undef ASSERT_CHAIN_INVARIANT
+
+#endif // vim:ai:sw=4:ts=4:syntax=cpp
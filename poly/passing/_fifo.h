@@ -9,45 +9,77 @@
 //#include <stdlib.h>
 extern void  free(void*);
 extern void* calloc(size_t, size_t);
+//#include <string.h>
+extern void* memcpy(void*, void const*, size_t);
+
+/*
+ * Buffer of Scalars for callers that provide their own mutual exclusion.
+ * Read and write cursors grow monotonically (overflow is welcome) and
+ * index the buffer through a mask: the buffer length is `capacity` rounded
+ * up to a power of two. Each cursor lives in its own cache line, so the
+ * putting and getting sides do not write the same line.
+ *
+ * Slots are Scalars here; Ring (see _ring.h) reuses the same buffer and
+ * cursors with slots of any record size.
+ */
 
 ////////////////////////////////////////////////////////////////////////
 // FIFO interface (buffer of Scalars)
 ////////////////////////////////////////////////////////////////////////
 
 typedef struct FIFO {
-	Scalar*   buffer;
-	unsigned  size;
-	unsigned  count;
-	unsigned  front;
+	// read only
+	Scalar*   buffer;   // Scalars, or Ring records `stride` bytes apart
+	unsigned  mask;
+	unsigned  capacity;
+	unsigned  size;     // record size in bytes
+	unsigned  stride;   // slot size in bytes
+	// written by fifo_put
+	CACHE_ALIGNED
+	unsigned  write;
+	// written by fifo_get
+	CACHE_ALIGNED
+	unsigned  read;
 } FIFO;
 
-static int    fifo_init(FIFO *const this, unsigned size);
-static void   fifo_destroy(FIFO *const this);
-static bool   fifo_empty(FIFO const*const this);
-static bool   fifo_full(FIFO const*const this);
-static void   fifo_put(FIFO *const this, Scalar scalar);
-static Scalar fifo_get(FIFO *const this);
+static int      fifo_init(FIFO *const this, unsigned capacity);
+static void     fifo_destroy(FIFO *const this);
+static unsigned fifo_count(FIFO const*const this);
+static bool     fifo_empty(FIFO const*const this);
+static bool     fifo_full(FIFO const*const this);
+static void     fifo_put(FIFO *const this, Scalar scalar);
+static Scalar   fifo_get(FIFO *const this);
+static unsigned fifo_put_n(FIFO *const this, Scalar const source[], unsigned n);
+static unsigned fifo_get_n(FIFO *const this, Scalar target[], unsigned n);
 
 ////////////////////////////////////////////////////////////////////////
 // FIFO implementation
 ////////////////////////////////////////////////////////////////////////
 
 #ifdef DEBUG
-#   define ASSERT_FIFO_INVARIANT                               \
-        assert(0 <= this->count && this->count <= this->size); \
-        assert(0 <= this->front && this->front < this->size);  \
-        assert(this->buffer != NULL);                          \
-        assert(!(fifo_empty(this) && fifo_full(this)));
+#   define ASSERT_FIFO_INVARIANT                        \
+        assert(fifo_count(this) <= this->capacity);     \
+        assert(this->capacity <= this->mask+1);         \
+        assert((this->mask & (this->mask+1)) == 0);     \
+        assert(this->size <= this->stride);             \
+        assert(this->buffer != NULL);
 #else
 #   define ASSERT_FIFO_INVARIANT
 #endif
 
+// private: slots of `size` bytes rounded up to 8 (see `ring_init`)
 static int
-fifo_init (FIFO *const this, unsigned size)
+fifo_init_slots_ (FIFO *const this, unsigned capacity, unsigned size)
 {
+	assert(0 < capacity && capacity <= (1u << 31));
+	assert(size > 0);
+
+	this->capacity = capacity;
+	this->mask = pow2_ceil(capacity) - 1;
 	this->size = size;
-	this->front = this->count = 0;
-	this->buffer = calloc(this->size, sizeof(Scalar));
+	this->stride = (size + 7u) & ~7u;
+	this->read = this->write = 0;
+	this->buffer = calloc(this->mask+1, this->stride);
 
 	if (this->buffer == NULL) {
 		return STATUS_NOMEM;
@@ -57,6 +89,12 @@ fifo_init (FIFO *const this, unsigned size)
 	return STATUS_SUCCESS;
 }
 
+static ALWAYS inline int
+fifo_init (FIFO *const this, unsigned capacity)
+{
+	return fifo_init_slots_(this, capacity, sizeof(Scalar));
+}
+
 static void
 fifo_destroy (FIFO *const this)
 {
@@ -64,37 +102,89 @@ fifo_destroy (FIFO *const this)
 	this->buffer = NULL;
 }
 
+static ALWAYS inline unsigned
+fifo_count (FIFO const*const this)
+{
+	return this->write - this->read;
+}
+
 static ALWAYS inline bool
 fifo_empty (FIFO const*const this)
 {
-	return this->count == 0;
+	return this->write == this->read;
 }
 
 static ALWAYS inline bool
 fifo_full (FIFO const*const this)
 {
-	return this->count == this->size;
+	return fifo_count(this) == this->capacity;
+}
+
+// private: the slot at `cursor` (see `ring_put` and `ring_get`)
+static ALWAYS inline void*
+fifo_slot_ (FIFO const*const this, unsigned cursor)
+{
+	return (char*)this->buffer + (size_t)(cursor & this->mask) * this->stride;
 }
 
 static ALWAYS inline void
 fifo_put (FIFO *const this, Scalar scalar)
 {
-	this->buffer[this->front] = scalar;
-	this->front = (this->front+1) % this->size;
-	++this->count;
+	assert(!fifo_full(this));
+
+	this->buffer[this->write & this->mask] = scalar;
+	++this->write;
 	ASSERT_FIFO_INVARIANT
 }
 
 static ALWAYS inline Scalar
 fifo_get (FIFO *const this)
 {
-	register int back = this->front - this->count;
-	if (back < 0) {
-		back += this->size;
-	}
-	--this->count;
+	assert(!fifo_empty(this));
+
+	Scalar const scalar = this->buffer[this->read & this->mask];
+	++this->read;
+	ASSERT_FIFO_INVARIANT
+	return scalar;
+}
+
+/*
+ * Bulk transfers move as many Scalars as possible (at most `n`) and return
+ * how many; the wrap-around is handled with two contiguous copies.
+ */
+
+static inline unsigned
+fifo_put_n (FIFO *const this, Scalar const source[], unsigned n)
+{
+	unsigned const room = this->capacity - fifo_count(this);
+	if (n > room) { n = room; }
+
+	unsigned const index = this->write & this->mask;
+	unsigned const first = (n < this->mask+1 - index) ? n : this->mask+1 - index;
+	memcpy(&this->buffer[index], source, first*sizeof(Scalar));
+	memcpy(&this->buffer[0], source+first, (n-first)*sizeof(Scalar));
+
+	this->write += n;
+	ASSERT_FIFO_INVARIANT
+
+	return n;
+}
+
+static inline unsigned
+fifo_get_n (FIFO *const this, Scalar target[], unsigned n)
+{
+	unsigned const count = fifo_count(this);
+	if (n > count) { n = count; }
+
+	unsigned const index = this->read & this->mask;
+	unsigned const first = (n < this->mask+1 - index) ? n : this->mask+1 - index;
+	memcpy(target, &this->buffer[index], first*sizeof(Scalar));
+	memcpy(target+first, &this->buffer[0], (n-first)*sizeof(Scalar));
+
+	this->read += n;
 	ASSERT_FIFO_INVARIANT
-	return this->buffer[back];
+
+	return n;
 }
 
 #undef ASSERT_FIFO_INVARIANT
@@ -0,0 +1,172 @@
+#ifndef POLY_MPMC_H
+#define POLY_MPMC_H
+
+#ifndef POLY_H
+#include "../POLY.h"
+#endif
+#include "../atomics.h"
+#include "../scalar.h"
+
+//#include <stdlib.h>
+extern void  free(void*);
+extern void* calloc(size_t, size_t);
+
+/*
+ * Bounded lock-free ring of Scalars for many producers and consumers
+ * (Dmitry Vyukov's design). Each slot carries a sequence number telling
+ * which lap of the cursors may use it next, so producers and consumers
+ * only contend on their own cursor. Capacity is rounded up to a power of
+ * two, and to 2 at least (with one slot "full" and "free" look alike).
+ */
+
+////////////////////////////////////////////////////////////////////////
+// MPMC interface (ring of Scalars)
+////////////////////////////////////////////////////////////////////////
+
+typedef struct MPMC {
+	CACHE_ALIGNED
+	atomic(unsigned) enqueue; // next position to write
+	CACHE_ALIGNED
+	atomic(unsigned) dequeue; // next position to read
+	CACHE_ALIGNED
+	struct MPMCSlot {
+		atomic(unsigned) sequence;
+		Scalar           value;
+	}*               buffer;
+	unsigned         mask;
+} MPMC;
+
+static int      mpmc_init(MPMC *const this, unsigned capacity);
+static void     mpmc_destroy(MPMC *const this);
+static unsigned mpmc_capacity(MPMC const*const this);
+static bool     mpmc_empty(MPMC const*const this);
+static bool     mpmc_full(MPMC const*const this);
+static bool     mpmc_put(MPMC *const this, Scalar scalar);
+static bool     mpmc_get(MPMC *const this, Scalar scalar[static 1]);
+
+////////////////////////////////////////////////////////////////////////
+// MPMC implementation
+////////////////////////////////////////////////////////////////////////
+
+#ifdef DEBUG
+#   define ASSERT_MPMC_INVARIANT      \
+        assert(this->buffer != NULL); \
+        assert((this->mask & (this->mask+1)) == 0);
+#else
+#   define ASSERT_MPMC_INVARIANT
+#endif
+
+static int
+mpmc_init (MPMC *const this, unsigned capacity)
+{
+	assert(0 < capacity && capacity <= (1u << 31));
+
+	this->mask = pow2_ceil(capacity < 2 ? 2 : capacity) - 1;
+	STORE(&this->enqueue, 0, RELAXED);
+	STORE(&this->dequeue, 0, RELAXED);
+	this->buffer = calloc(this->mask+1, sizeof(struct MPMCSlot));
+
+	if (this->buffer == NULL) {
+		return STATUS_NOMEM;
+	}
+	for (unsigned i = 0; i <= this->mask; ++i) {
+		STORE(&this->buffer[i].sequence, i, RELAXED);
+	}
+	ASSERT_MPMC_INVARIANT
+
+	return STATUS_SUCCESS;
+}
+
+static void
+mpmc_destroy (MPMC *const this)
+{
+	free(this->buffer);
+	this->buffer = NULL;
+}
+
+static ALWAYS inline unsigned
+mpmc_capacity (MPMC const*const this)
+{
+	return this->mask+1;
+}
+
+/*
+ * Observers look at the slot under the cursor: they tell whether the next
+ * put or get would succeed now, a snapshot when other threads are active.
+ */
+
+static ALWAYS inline bool
+mpmc_empty (MPMC const*const this)
+{
+	unsigned const pos = LOAD(&this->dequeue, RELAXED);
+	unsigned const seq = LOAD(&this->buffer[pos & this->mask].sequence, ACQUIRE);
+	return (signed)(seq - (pos+1)) < 0;
+}
+
+static ALWAYS inline bool
+mpmc_full (MPMC const*const this)
+{
+	unsigned const pos = LOAD(&this->enqueue, RELAXED);
+	unsigned const seq = LOAD(&this->buffer[pos & this->mask].sequence, ACQUIRE);
+	return (signed)(seq - pos) < 0;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+// false if the ring is full
+static inline bool
+mpmc_put (MPMC *const this, Scalar scalar)
+{
+	struct MPMCSlot* slot;
+	unsigned pos = LOAD(&this->enqueue, RELAXED);
+
+	for (;;) {
+		slot = &this->buffer[pos & this->mask];
+		unsigned const seq = LOAD(&slot->sequence, ACQUIRE);
+		signed const diff = (signed)(seq - pos);
+		if (diff == 0) {
+			if (CASw(&this->enqueue, &pos, pos+1, RELAXED, RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) {
+			return false;
+		} else {
+			pos = LOAD(&this->enqueue, RELAXED);
+		}
+	}
+	slot->value = scalar;
+	STORE(&slot->sequence, pos+1, RELEASE);
+
+	return true;
+}
+
+// false if the ring is empty
+static inline bool
+mpmc_get (MPMC *const this, Scalar scalar[static 1])
+{
+	struct MPMCSlot* slot;
+	unsigned pos = LOAD(&this->dequeue, RELAXED);
+
+	for (;;) {
+		slot = &this->buffer[pos & this->mask];
+		unsigned const seq = LOAD(&slot->sequence, ACQUIRE);
+		signed const diff = (signed)(seq - (pos+1));
+		if (diff == 0) {
+			if (CASw(&this->dequeue, &pos, pos+1, RELAXED, RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) {
+			return false;
+		} else {
+			pos = LOAD(&this->dequeue, RELAXED);
+		}
+	}
+	scalar[0] = slot->value;
+	STORE(&slot->sequence, pos+this->mask+1, RELEASE);
+
+	return true;
+}
+
+#undef ASSERT_MPMC_INVARIANT
+
+#endif // vim:ai:sw=4:ts=4:syntax=cpp
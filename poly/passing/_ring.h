@@ -0,0 +1,93 @@
+#ifndef POLY_RING_H
+#define POLY_RING_H
+
+#ifndef POLY_H
+#include "../POLY.h"
+#endif
+#include "_fifo.h"
+
+//#include <string.h>
+extern void* memcpy(void*, void const*, size_t);
+
+/*
+ * Buffer of fixed size records for callers that provide their own mutual
+ * exclusion. Records are stored inline and copied in and out by value;
+ * slots are `size` bytes rounded up to 8. Buffer and cursors are those of
+ * a FIFO with record slots instead of Scalars.
+ */
+
+////////////////////////////////////////////////////////////////////////
+// Ring interface (buffer of records)
+////////////////////////////////////////////////////////////////////////
+
+typedef struct Ring { FIFO slots; } Ring;
+
+static int      ring_init(Ring *const this, unsigned capacity, unsigned size);
+static void     ring_destroy(Ring *const this);
+static unsigned ring_count(Ring const*const this);
+static bool     ring_empty(Ring const*const this);
+static bool     ring_full(Ring const*const this);
+static unsigned ring_size(Ring const*const this);
+static void     ring_put(Ring *const this, void const* record);
+static void     ring_get(Ring *const this, void* record);
+
+////////////////////////////////////////////////////////////////////////
+// Ring implementation
+////////////////////////////////////////////////////////////////////////
+
+static ALWAYS inline int
+ring_init (Ring *const this, unsigned capacity, unsigned size)
+{
+	return fifo_init_slots_(&this->slots, capacity, size);
+}
+
+static ALWAYS inline void
+ring_destroy (Ring *const this)
+{
+	fifo_destroy(&this->slots);
+}
+
+static ALWAYS inline unsigned
+ring_count (Ring const*const this)
+{
+	return fifo_count(&this->slots);
+}
+
+static ALWAYS inline bool
+ring_empty (Ring const*const this)
+{
+	return fifo_empty(&this->slots);
+}
+
+static ALWAYS inline bool
+ring_full (Ring const*const this)
+{
+	return fifo_full(&this->slots);
+}
+
+// Record size in bytes
+static ALWAYS inline unsigned
+ring_size (Ring const*const this)
+{
+	return this->slots.size;
+}
+
+static ALWAYS inline void
+ring_put (Ring *const this, void const* record)
+{
+	assert(!ring_full(this));
+
+	memcpy(fifo_slot_(&this->slots, this->slots.write), record, this->slots.size);
+	++this->slots.write;
+}
+
+static ALWAYS inline void
+ring_get (Ring *const this, void* record)
+{
+	assert(!ring_empty(this));
+
+	memcpy(record, fifo_slot_(&this->slots, this->slots.read), this->slots.size);
+	++this->slots.read;
+}
+
+#endif // vim:ai:sw=4:ts=4:syntax=cpp
@@ -0,0 +1,151 @@
+#ifndef POLY_SPSC_H
+#define POLY_SPSC_H
+
+#ifndef POLY_H
+#include "../POLY.h"
+#endif
+#include "../atomics.h"
+#include "../scalar.h"
+
+//#include <stdlib.h>
+extern void  free(void*);
+extern void* calloc(size_t, size_t);
+
+/*
+ * Wait-free ring of Scalars for one producer and one consumer. Cursors
+ * grow monotonically and index the buffer through a mask, so the buffer
+ * length is `capacity` rounded up to a power of two.
+ */
+
+////////////////////////////////////////////////////////////////////////
+// SPSC interface (ring of Scalars)
+////////////////////////////////////////////////////////////////////////
+
+typedef struct SPSC {
+	// written by the consumer
+	CACHE_ALIGNED
+	atomic(unsigned) head;       // next slot to read
+	unsigned         tail_cache; // consumer copy of `tail`
+	// written by the producer
+	CACHE_ALIGNED
+	atomic(unsigned) tail;       // next slot to write
+	unsigned         head_cache; // producer copy of `head`
+	// read only
+	CACHE_ALIGNED
+	Scalar*          buffer;
+	unsigned         mask;
+	unsigned         capacity;
+} SPSC;
+
+static int      spsc_init(SPSC *const this, unsigned capacity);
+static void     spsc_destroy(SPSC *const this);
+static unsigned spsc_count(SPSC const*const this);
+static bool     spsc_empty(SPSC const*const this);
+static bool     spsc_full(SPSC const*const this);
+static bool     spsc_put(SPSC *const this, Scalar scalar);
+static bool     spsc_get(SPSC *const this, Scalar scalar[static 1]);
+
+////////////////////////////////////////////////////////////////////////
+// SPSC implementation
+////////////////////////////////////////////////////////////////////////
+
+#ifdef DEBUG
+#   define ASSERT_SPSC_INVARIANT                  \
+        assert(this->buffer != NULL);             \
+        assert(this->capacity <= this->mask+1);   \
+        assert(spsc_count(this) <= this->capacity);
+#else
+#   define ASSERT_SPSC_INVARIANT
+#endif
+
+static int
+spsc_init (SPSC *const this, unsigned capacity)
+{
+	assert(0 < capacity && capacity <= (1u << 31));
+
+	this->capacity = capacity;
+	this->mask = pow2_ceil(capacity) - 1;
+	this->head_cache = this->tail_cache = 0;
+	STORE(&this->head, 0, RELAXED);
+	STORE(&this->tail, 0, RELAXED);
+	this->buffer = calloc(this->mask+1, sizeof(Scalar));
+
+	if (this->buffer == NULL) {
+		return STATUS_NOMEM;
+	}
+	ASSERT_SPSC_INVARIANT
+
+	return STATUS_SUCCESS;
+}
+
+static void
+spsc_destroy (SPSC *const this)
+{
+	free(this->buffer);
+	this->buffer = NULL;
+}
+
+/*
+ * Observers are exact only when called from the producer or the consumer;
+ * from a third thread they are a snapshot.
+ */
+
+static ALWAYS inline unsigned
+spsc_count (SPSC const*const this)
+{
+	return LOAD(&this->tail, ACQUIRE) - LOAD(&this->head, ACQUIRE);
+}
+
+static ALWAYS inline bool
+spsc_empty (SPSC const*const this)
+{
+	return spsc_count(this) == 0;
+}
+
+static ALWAYS inline bool
+spsc_full (SPSC const*const this)
+{
+	return spsc_count(this) == this->capacity;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+// Producer side: false if the ring is full
+static ALWAYS inline bool
+spsc_put (SPSC *const this, Scalar scalar)
+{
+	unsigned const tail = LOAD(&this->tail, RELAXED);
+
+	if (tail - this->head_cache == this->capacity) {
+		this->head_cache = LOAD(&this->head, ACQUIRE);
+		if (tail - this->head_cache == this->capacity) {
+			return false;
+		}
+	}
+	this->buffer[tail & this->mask] = scalar;
+	STORE(&this->tail, tail+1, RELEASE);
+
+	return true;
+}
+
+// Consumer side: false if the ring is empty
+static ALWAYS inline bool
+spsc_get (SPSC *const this, Scalar scalar[static 1])
+{
+	unsigned const head = LOAD(&this->head, RELAXED);
+
+	if (head == this->tail_cache) {
+		this->tail_cache = LOAD(&this->tail, ACQUIRE);
+		if (head == this->tail_cache) {
+			return false;
+		}
+	}
+	scalar[0] = this->buffer[head & this->mask];
+	STORE(&this->head, head+1, RELEASE);
+
+	return true;
+}
+
+#undef ASSERT_SPSC_INVARIANT
+
+#endif // vim:ai:sw=4:ts=4:syntax=cpp
@@ -9,7 +9,16 @@
 #include "../monitor/notice.h"
 #include "../monitor/board.h"
 #include "../scalar.h"
+#include "../atomics.h"
+#include "_chain.h"
 #include "_fifo.h"
+#include "_spsc.h"
+#include "_mpmc.h"
+#include "_cfifo.h"
+
+//#include <stdlib.h>
+extern void* aligned_alloc(size_t, size_t);
+extern void  free(void*);
 
 ////////////////////////////////////////////////////////////////////////
 // Channel interface
@@ -29,21 +38,67 @@ typedef struct Channel {
 			Condition non_empty;
 			Condition non_full;
 			bool      buffered;
+			// lock-free modes: # of threads parked on each condition
+			atomic(unsigned) receivers;
+			atomic(unsigned) senders;
 		};
 	};
 	union {
 		FIFO   queue; // for capacity >  1
 		Scalar value; // for capacity <= 1
+		SPSC   ring;  // for single producer/consumer mode
+		MPMC   slots; // for multiple producers/consumers mode
+		CFIFO* combined; // for combining mode (out of line: cache aligned)
+		Chain  chain; // for unbounded mode
 	};
+	struct Alternative* watchers; // `channel_select` cases waiting here
 } Channel;
 
 static void channel_close(Channel *const this);
 static void channel_destroy(Channel *const this);
 static bool channel_dry(Channel const*const this);
 static int  channel_init(Channel *const this, unsigned capacity);
+static int  channel_init_combining(Channel *const this, unsigned capacity);
+static int  channel_init_mpmc(Channel *const this, unsigned capacity);
+static int  channel_init_spsc(Channel *const this, unsigned capacity);
+static int  channel_init_unbounded(Channel *const this);
 static bool channel_ready(Channel const*const this);
 static int  channel_receive(Channel *const this, Scalar response[static 1]);
+static int  channel_receive_n(Channel *const this, Scalar response[], unsigned max, unsigned count[static 1]);
+static int  channel_receive_until(Channel *const this, Scalar response[static 1], Clock deadline);
 static int  channel_send(Channel *const this, Scalar scalar);
+static int  channel_send_n(Channel *const this, Scalar const scalars[], unsigned n);
+static int  channel_send_until(Channel *const this, Scalar scalar, Clock deadline);
+static int  channel_try_receive(Channel *const this, Scalar response[static 1]);
+static int  channel_try_send(Channel *const this, Scalar scalar);
+
+/*
+ * Cases for `channel_select`: the message to send, or the received one, is
+ * kept in `scalar`; cases with a false `guard` are ignored.
+ */
+typedef struct Alternative {
+	Channel*  channel;
+	unsigned  kind;
+	bool      guard;
+	Scalar    scalar;
+	// private: link in the channel list of watchers
+	struct Selector*    selector_;
+	struct Alternative* next_;
+} Alternative;
+
+// Constants for kind
+enum { ALT_KIND_SEND='s', ALT_KIND_RECEIVE='r' };
+
+#define ALT_SEND(C,S,...) \
+    (Alternative){.channel=(C), .kind=ALT_KIND_SEND, .guard=true, .scalar=(S) __VA_OPT__(,)__VA_ARGS__}
+
+#define ALT_RECEIVE(C,...) \
+    (Alternative){.channel=(C), .kind=ALT_KIND_RECEIVE, .guard=true __VA_OPT__(,)__VA_ARGS__}
+
+// negative timeouts (or deadlines) wait forever
+#define CHANNEL_FOREVER ((Clock)-1)
+
+static int  channel_select(unsigned n, Alternative alts[static n], Clock timeout, unsigned chosen[static 1]);
 
 #define run_filter(T,I,O,...) \
     run_thread(T, .input=(I), .output=(O) __VA_OPT__(,)__VA_ARGS__)
@@ -59,7 +114,14 @@ static int  channel_send(Channel *const this, Scalar scalar);
 enum { CHANNEL_CLOSED=0x01, CHANNEL_DRY=0x02 };
 
 // Constants for mode
-enum { CHANNEL_MODE_SYNC='S', CHANNEL_MODE_ASYNC='A' };
+enum {
+	CHANNEL_MODE_SYNC='S',
+	CHANNEL_MODE_ASYNC='A',
+	CHANNEL_MODE_SPSC='P',
+	CHANNEL_MODE_MPMC='M',
+	CHANNEL_MODE_COMBINING='C',
+	CHANNEL_MODE_UNBOUNDED='U'
+};
 
 #ifdef DEBUG
 #   define ASSERT_CHANNEL_INVARIANT                 \
@@ -77,6 +139,7 @@ channel_init (Channel *const this, unsigned capacity)
 
 	this->occupation = this->flags = 0;
 	this->capacity = capacity;
+	this->watchers = NULL;
 	err = lock_init(&this->syncronized);
 	if (err != STATUS_SUCCESS) { return err; }
 
@@ -121,10 +184,139 @@ onerror:
 	return err;
 }
 
+/*
+ * Unbounded channels: an asyncronous channel whose buffer is a chain of
+ * segments allocated as messages arrive, so senders never block (they
+ * fail with STATUS_NOMEM when memory is exhausted).
+ */
+
+static inline int
+channel_init_unbounded (Channel *const this)
+{
+	int err;
+
+	this->occupation = this->flags = 0;
+	this->capacity = ~0u;
+	this->mode = CHANNEL_MODE_UNBOUNDED;
+	this->buffered = true;
+	this->watchers = NULL;
+
+	if ((err=lock_init(&this->syncronized)) != STATUS_SUCCESS) {
+		return err;
+	}
+	catch (chain_init(&this->chain));
+	if ((err=condition_init(&this->non_empty)) != STATUS_SUCCESS) {
+		chain_destroy(&this->chain);
+		goto onerror;
+	}
+	if ((err=condition_init(&this->non_full)) != STATUS_SUCCESS) {
+		condition_destroy(&this->non_empty);
+		chain_destroy(&this->chain);
+		goto onerror;
+	}
+	ASSERT_CHANNEL_INVARIANT
+
+	return STATUS_SUCCESS;
+onerror:
+	lock_destroy(&this->syncronized);
+	return err;
+}
+
+/*
+ * Lock-free channels: messages go through a lock-free ring, and the lock
+ * and conditions are used only to park a side when the ring is full or
+ * empty.
+ *
+ *  SPSC: exactly one sender and one receiver thread (wait-free ring)
+ *  MPMC: any number of senders and receivers (capacity rounded up to a
+ *        power of two)
+ *  Combining: any number of senders and receivers, with a flat combining
+ *        FIFO instead of a ring (for many threads hammering one channel)
+ */
+
+static int
+channel_init_lockfree_ (Channel *const this, unsigned capacity, unsigned mode)
+{
+	assert(capacity > 0);
+	int err;
+
+	this->occupation = this->flags = 0;
+	this->capacity = capacity;
+	this->mode = mode;
+	this->buffered = true;
+	this->watchers = NULL;
+	STORE(&this->receivers, 0, RELAXED);
+	STORE(&this->senders, 0, RELAXED);
+
+	if ((err=lock_init(&this->syncronized)) != STATUS_SUCCESS) {
+		return err;
+	}
+	switch (mode) {
+		case CHANNEL_MODE_SPSC:
+			err = spsc_init(&this->ring, capacity);
+			break;
+		case CHANNEL_MODE_MPMC:
+			err = mpmc_init(&this->slots, capacity);
+			this->capacity = mpmc_capacity(&this->slots);
+			break;
+		case CHANNEL_MODE_COMBINING:
+			if ((this->combined=aligned_alloc(_Alignof(CFIFO), sizeof(CFIFO))) == NULL) {
+				err = STATUS_NOMEM;
+			} else if ((err=cfifo_init(this->combined, capacity)) != STATUS_SUCCESS) {
+				free(this->combined);
+			}
+			break;
+		default:
+			assert(internal_error);
+			err = STATUS_ERROR;
+	}
+	if (err != STATUS_SUCCESS) {
+		goto onerror;
+	}
+	if ((err=condition_init(&this->non_empty)) != STATUS_SUCCESS) {
+		goto onerror_ring;
+	}
+	if ((err=condition_init(&this->non_full)) != STATUS_SUCCESS) {
+		condition_destroy(&this->non_empty);
+		goto onerror_ring;
+	}
+	ASSERT_CHANNEL_INVARIANT
+
+	return STATUS_SUCCESS;
+onerror_ring:
+	switch (mode) {
+		case CHANNEL_MODE_SPSC: spsc_destroy(&this->ring); break;
+		case CHANNEL_MODE_MPMC: mpmc_destroy(&this->slots); break;
+		case CHANNEL_MODE_COMBINING: cfifo_destroy(this->combined); free(this->combined); break;
+	}
+onerror:
+	lock_destroy(&this->syncronized);
+	return err;
+}
+
+static ALWAYS inline int
+channel_init_spsc (Channel *const this, unsigned capacity)
+{
+	return channel_init_lockfree_(this, capacity, CHANNEL_MODE_SPSC);
+}
+
+static ALWAYS inline int
+channel_init_mpmc (Channel *const this, unsigned capacity)
+{
+	return channel_init_lockfree_(this, capacity, CHANNEL_MODE_MPMC);
+}
+
+static ALWAYS inline int
+channel_init_combining (Channel *const this, unsigned capacity)
+{
+	return channel_init_lockfree_(this, capacity, CHANNEL_MODE_COMBINING);
+}
+
 static void
 channel_destroy (Channel *const this)
 {
 	assert(this->occupation == 0); // empty
+	assert(this->watchers == NULL);
 
 	switch (this->mode) {
 		case CHANNEL_MODE_SYNC:
@@ -137,6 +329,30 @@ channel_destroy (Channel *const this)
 				fifo_destroy(&this->queue);
 			}
 			break;
+		case CHANNEL_MODE_UNBOUNDED:
+			condition_destroy(&this->non_full);
+			condition_destroy(&this->non_empty);
+			chain_destroy(&this->chain);
+			break;
+		case CHANNEL_MODE_SPSC:
+			assert(spsc_empty(&this->ring));
+			condition_destroy(&this->non_full);
+			condition_destroy(&this->non_empty);
+			spsc_destroy(&this->ring);
+			break;
+		case CHANNEL_MODE_MPMC:
+			assert(mpmc_empty(&this->slots));
+			condition_destroy(&this->non_full);
+			condition_destroy(&this->non_empty);
+			mpmc_destroy(&this->slots);
+			break;
+		case CHANNEL_MODE_COMBINING:
+			assert(cfifo_empty(this->combined));
+			condition_destroy(&this->non_full);
+			condition_destroy(&this->non_empty);
+			cfifo_destroy(this->combined);
+			free(this->combined);
+			break;
 	}
 
 	lock_destroy(&this->syncronized);
@@ -144,13 +360,142 @@ channel_destroy (Channel *const this)
 
 ////////////////////////////////////////////////////////////////////////
 
+static ALWAYS inline bool
+channel_lockfree_ (Channel const*const this)
+{
+	return this->mode == CHANNEL_MODE_SPSC || this->mode == CHANNEL_MODE_MPMC
+	    || this->mode == CHANNEL_MODE_COMBINING;
+}
+
+static ALWAYS inline bool
+channel_empty_ (Channel const*const this)
+{
+	switch (this->mode) {
+		case CHANNEL_MODE_SPSC: return spsc_empty(&this->ring);
+		case CHANNEL_MODE_MPMC: return mpmc_empty(&this->slots);
+		default:                return cfifo_empty(this->combined);
+	}
+}
+
+static ALWAYS inline bool
+channel_full_ (Channel const*const this)
+{
+	switch (this->mode) {
+		case CHANNEL_MODE_SPSC: return spsc_full(&this->ring);
+		case CHANNEL_MODE_MPMC: return mpmc_full(&this->slots);
+		default:                return cfifo_full(this->combined);
+	}
+}
+
+static ALWAYS inline bool
+channel_put_ (Channel *const this, Scalar scalar)
+{
+	switch (this->mode) {
+		case CHANNEL_MODE_SPSC: return spsc_put(&this->ring, scalar);
+		case CHANNEL_MODE_MPMC: return mpmc_put(&this->slots, scalar);
+		default:                return cfifo_put(this->combined, scalar);
+	}
+}
+
+static ALWAYS inline bool
+channel_get_ (Channel *const this, Scalar response[static 1])
+{
+	switch (this->mode) {
+		case CHANNEL_MODE_SPSC: return spsc_get(&this->ring, response);
+		case CHANNEL_MODE_MPMC: return mpmc_get(&this->slots, response);
+		default:                return cfifo_get(this->combined, response);
+	}
+}
+
+/*
+ * Buffer access for the lock based asyncronous modes (call with the lock
+ * held).
+ */
+
+static ALWAYS inline int
+channel_store_ (Channel *const this, Scalar scalar)
+{
+	if (this->mode == CHANNEL_MODE_UNBOUNDED) {
+		return chain_put(&this->chain, scalar);
+	}
+	if (this->buffered) {
+		fifo_put(&this->queue, scalar);
+	} else {
+		this->value = scalar;
+	}
+	return STATUS_SUCCESS;
+}
+
+static ALWAYS inline Scalar
+channel_fetch_ (Channel *const this)
+{
+	if (this->mode == CHANNEL_MODE_UNBOUNDED) {
+		return chain_get(&this->chain);
+	}
+	return this->buffered ? fifo_get(&this->queue) : this->value;
+}
+
+static ALWAYS inline unsigned
+channel_store_n_ (Channel *const this, Scalar const scalars[], unsigned n)
+{
+	return (this->mode == CHANNEL_MODE_UNBOUNDED)
+		? chain_put_n(&this->chain, scalars, n) : fifo_put_n(&this->queue, scalars, n);
+}
+
+static ALWAYS inline unsigned
+channel_fetch_n_ (Channel *const this, Scalar response[], unsigned max)
+{
+	return (this->mode == CHANNEL_MODE_UNBOUNDED)
+		? chain_get_n(&this->chain, response, max) : fifo_get_n(&this->queue, response, max);
+}
+
+/*
+ * Selector: the shared wait object of a `channel_select` call.
+ */
+typedef struct Selector {
+	Lock      syncronized;
+	Condition queue;
+	bool      fired; // some watched channel changed
+} Selector;
+
+// Wake up the selects watching this channel (call with the lock held)
+static inline void
+channel_notify_ (Channel *const this)
+{
+	for (Alternative* alt = this->watchers; alt != NULL; alt = alt->next_) {
+		Selector *const selector = alt->selector_;
+		lock_acquire(&selector->syncronized);
+		selector->fired = true;
+		condition_signal(&selector->queue);
+		lock_release(&selector->syncronized);
+	}
+}
+
 static inline void
 channel_close (Channel *const this)
 {
+	if (channel_lockfree_(this)) {
+		this->flags |= CHANNEL_CLOSED;
+		if (channel_empty_(this)) {
+			this->flags |= CHANNEL_DRY;
+		}
+		// let parked receivers notice the closing
+		atomic_thread_fence(SEQ_CST);
+		if (LOAD(&this->receivers, RELAXED) != 0 || LOAD(&this->senders, RELAXED) != 0) {
+			lock_acquire(&this->syncronized);
+			condition_broadcast(&this->non_empty);
+			channel_notify_(this);
+			lock_release(&this->syncronized);
+		}
+		return;
+	}
+	lock_acquire(&this->syncronized);
 	this->flags |= CHANNEL_CLOSED;
 	if (this->occupation == 0) {
 		this->flags |= CHANNEL_DRY;
 	}
+	channel_notify_(this);
+	lock_release(&this->syncronized);
 }
 
 static ALWAYS inline bool
@@ -162,79 +507,532 @@ channel_dry (Channel const*const this)
 static ALWAYS inline bool
 channel_ready (Channel const*const this)
 {
+	if (channel_lockfree_(this)) {
+		return !channel_empty_(this);
+	}
 	return this->occupation != 0; // thread safe?
 }
 
 ////////////////////////////////////////////////////////////////////////
+// Lock-free modes
+////////////////////////////////////////////////////////////////////////
+
+/*
+ * A side that finds the ring full (or empty) registers in `senders` (or
+ * `receivers`) and sleeps on the condition, always rechecking under the
+ * lock. The other side publishes its change, then checks the register:
+ * the SEQ_CST fences on both sides ensure at least one of them sees the
+ * other, so no wakeup is lost and the lock is untouched while nobody
+ * sleeps.
+ */
+
+// Wait on `queue` until `deadline`, or forever if `deadline` is negative
+static ALWAYS inline int
+channel_wait_ (Channel *const this, Condition* queue, Clock deadline)
+{
+	return (deadline < 0)
+		? condition_wait(queue, &this->syncronized)
+		: condition_wait_until(queue, &this->syncronized, deadline);
+}
+
+static ALWAYS inline int
+channel_wake_ (Channel *const this, atomic(unsigned)* parked, Condition* queue, bool all)
+{
+	atomic_thread_fence(SEQ_CST);
+	if (LOAD(parked, RELAXED) == 0) {
+		return STATUS_SUCCESS;
+	}
+
+	MONITOR_ENTRY
+
+	catch (all ? condition_broadcast(queue) : condition_signal(queue));
+	channel_notify_(this);
+
+	ENTRY_END
+}
 
 static int
-channel_send (Channel *const this, Scalar scalar)
+channel_park_sender_ (Channel *const this, Clock deadline)
+{
+	MONITOR_ENTRY
+
+	reg_add(&this->senders, 1, RELAXED);
+	atomic_thread_fence(SEQ_CST);
+	while (channel_full_(this)) {
+		if ((err=channel_wait_(this, &this->non_full, deadline)) != STATUS_SUCCESS) {
+			if (err == STATUS_TIMEDOUT && !channel_full_(this)) {
+				break;
+			}
+			reg_sub(&this->senders, 1, RELAXED);
+			goto onerror;
+		}
+	}
+	reg_sub(&this->senders, 1, RELAXED);
+
+	ENTRY_END
+}
+
+static int
+channel_park_receiver_ (Channel *const this, Clock deadline)
+{
+	MONITOR_ENTRY
+
+	reg_add(&this->receivers, 1, RELAXED);
+	atomic_thread_fence(SEQ_CST);
+	while (channel_empty_(this) && !(CHANNEL_CLOSED & this->flags)) {
+		if ((err=channel_wait_(this, &this->non_empty, deadline)) != STATUS_SUCCESS) {
+			if (err == STATUS_TIMEDOUT && !channel_empty_(this)) {
+				break;
+			}
+			reg_sub(&this->receivers, 1, RELAXED);
+			goto onerror;
+		}
+	}
+	reg_sub(&this->receivers, 1, RELAXED);
+
+	ENTRY_END
+}
+
+static inline int
+channel_send_lockfree_ (Channel *const this, Scalar scalar, Clock deadline)
+{
+	int err;
+
+	while (!channel_put_(this, scalar)) { // while full
+		catch (channel_park_sender_(this, deadline));
+	}
+	catch (channel_wake_(this, &this->receivers, &this->non_empty, false));
+
+	return STATUS_SUCCESS;
+onerror:
+	return err;
+}
+
+static inline int
+channel_receive_lockfree_ (Channel *const this, Scalar response[static 1], Clock deadline)
+{
+	int err;
+
+	while (!channel_get_(this, response)) { // while empty
+		if (CHANNEL_CLOSED & this->flags) {
+			if (channel_empty_(this)) {
+				this->flags |= CHANNEL_DRY;
+				response[0] = Unsigned(0x0);
+				return STATUS_SUCCESS;
+			}
+			continue;
+		}
+		catch (channel_park_receiver_(this, deadline));
+	}
+	if (CHANNEL_CLOSED & this->flags) {
+		if (channel_empty_(this)) {
+			this->flags |= CHANNEL_DRY;
+		}
+	}
+	catch (channel_wake_(this, &this->senders, &this->non_full, false));
+
+	return STATUS_SUCCESS;
+onerror:
+	return err;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+/*
+ * Send and receive block until `deadline` (a `now()` time point) at most,
+ * and fail with STATUS_TIMEDOUT when the partner, or room, is still
+ * missing by then. A negative deadline waits forever.
+ */
+
+static int
+channel_send_until (Channel *const this, Scalar scalar, Clock deadline)
 {
 	if (CHANNEL_CLOSED & this->flags) {
 		panic("cannot send to a closed channel");
 	}
+	if (channel_lockfree_(this)) {
+		return channel_send_lockfree_(this, scalar, deadline);
+	}
 
 	MONITOR_ENTRY
 
 	switch (this->mode) {
 		case CHANNEL_MODE_SYNC:
-			auto void thunk(void) {
-				this->value = scalar;
+			channel_notify_(this);
+			if (deadline < 0) {
+				catch (notice_wait(&this->board[0]));
+			} else {
+				catch (notice_wait_until(&this->board[0], deadline));
 			}
-			catch (board_send(this->board, thunk));;
+			this->value = scalar;
+			catch (notice_signal(&this->board[1]));
 			++this->occupation;
 			break;
 		case CHANNEL_MODE_ASYNC:
+		case CHANNEL_MODE_UNBOUNDED:
 			while (this->occupation == this->capacity) { // while full
-				catch (condition_wait(&this->non_full, &this->syncronized));;
+				if ((err=channel_wait_(this, &this->non_full, deadline)) != STATUS_SUCCESS) {
+					if (err == STATUS_TIMEDOUT && this->occupation < this->capacity) {
+						break;
+					}
+					goto onerror;
+				}
 			}
 
-			if (this->buffered) {
-				fifo_put(&this->queue, scalar);
-			} else {
-				this->value = scalar;
-			}
+			catch (channel_store_(this, scalar));
 			++this->occupation;
 
 			catch (condition_signal(&this->non_empty));;
+			channel_notify_(this);
+			break;
+	}
+	ASSERT_CHANNEL_INVARIANT
+
+	ENTRY_END
+}
+
+// Receive a value in the locked modes (the channel was not dry on entry)
+static int
+channel_receive_locked_ (Channel *const this, Scalar response[static 1], Clock deadline)
+{
+	MONITOR_ENTRY
+
+	switch (this->mode) {
+		case CHANNEL_MODE_SYNC:
+			channel_notify_(this);
+			if (deadline < 0) {
+				catch (board_receive(this->board));
+			} else {
+				catch (notice_signal(&this->board[0])); // offer to a sender
+				err = notice_wait_until(&this->board[1], deadline);
+				if (err == STATUS_TIMEDOUT) {
+					if (notice_revoke(&this->board[0])) { // withdraw the offer
+						goto onerror;
+					}
+					// a sender took the offer: the value is on its way
+					err = notice_wait(&this->board[1]);
+				}
+				catch (err);
+			}
+			response[0] = this->value;
+			--this->occupation;
+			break;
+		case CHANNEL_MODE_ASYNC:
+		case CHANNEL_MODE_UNBOUNDED:
+			while (this->occupation == 0) { // while empty
+				if ((err=channel_wait_(this, &this->non_empty, deadline)) != STATUS_SUCCESS) {
+					if (err == STATUS_TIMEDOUT && this->occupation > 0) {
+						break;
+					}
+					goto onerror;
+				}
+			}
+
+			response[0] = channel_fetch_(this);
+			--this->occupation;
+
+			catch (condition_signal(&this->non_full));
+			channel_notify_(this);
 			break;
 	}
+	if (this->occupation == 0) {
+		if (CHANNEL_CLOSED & this->flags) {
+			this->flags |= CHANNEL_DRY;
+		}
+	}
 	ASSERT_CHANNEL_INVARIANT
 
 	ENTRY_END
 }
 
 static int
+channel_receive_until (Channel *const this, Scalar response[static 1], Clock deadline)
+{
+	if (CHANNEL_DRY & this->flags) {
+		response[0] = Unsigned(0x0);
+		return STATUS_SUCCESS;
+	}
+	if (channel_lockfree_(this)) {
+		return channel_receive_lockfree_(this, response, deadline);
+	}
+	return channel_receive_locked_(this, response, deadline);
+}
+
+static ALWAYS inline int
+channel_send (Channel *const this, Scalar scalar)
+{
+	return channel_send_until(this, scalar, CHANNEL_FOREVER);
+}
+
+static ALWAYS inline int
 channel_receive (Channel *const this, Scalar response[static 1])
+{
+	return channel_receive_until(this, response, CHANNEL_FOREVER);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Non-blocking transfers
+////////////////////////////////////////////////////////////////////////
+
+// Send only if a receiver (or room) is ready now, else STATUS_BUSY
+static inline int
+channel_try_send (Channel *const this, Scalar scalar)
+{
+	if (CHANNEL_CLOSED & this->flags) {
+		panic("cannot send to a closed channel");
+	}
+	if (channel_lockfree_(this)) {
+		if (!channel_put_(this, scalar)) {
+			return STATUS_BUSY;
+		}
+		return channel_wake_(this, &this->receivers, &this->non_empty, false);
+	}
+
+	MONITOR_ENTRY
+
+	switch (this->mode) {
+		case CHANNEL_MODE_SYNC:
+			if (this->board[0].permits == 0) { // no receiver waiting
+				err = STATUS_BUSY;
+				goto onerror;
+			}
+			auto void thunk(void) {
+				this->value = scalar;
+			}
+			catch (board_send(this->board, thunk));
+			++this->occupation;
+			break;
+		case CHANNEL_MODE_ASYNC:
+		case CHANNEL_MODE_UNBOUNDED:
+			if (this->occupation == this->capacity) {
+				err = STATUS_BUSY;
+				goto onerror;
+			}
+			catch (channel_store_(this, scalar));
+			++this->occupation;
+
+			catch (condition_signal(&this->non_empty));
+			channel_notify_(this);
+			break;
+	}
+	ASSERT_CHANNEL_INVARIANT
+
+	ENTRY_END
+}
+
+// Receive only if a sender (or message) is ready now, else STATUS_BUSY
+static inline int
+channel_try_receive (Channel *const this, Scalar response[static 1])
 {
 	if (CHANNEL_DRY & this->flags) {
 		response[0] = Unsigned(0x0);
 		return STATUS_SUCCESS;
 	}
+	if (channel_lockfree_(this)) {
+		if (!channel_get_(this, response)) {
+			if (CHANNEL_CLOSED & this->flags) {
+				if (channel_empty_(this)) {
+					this->flags |= CHANNEL_DRY;
+					response[0] = Unsigned(0x0);
+					return STATUS_SUCCESS;
+				}
+			}
+			return STATUS_BUSY;
+		}
+		if (CHANNEL_CLOSED & this->flags) {
+			if (channel_empty_(this)) {
+				this->flags |= CHANNEL_DRY;
+			}
+		}
+		return channel_wake_(this, &this->senders, &this->non_full, false);
+	}
 
 	MONITOR_ENTRY
 
 	switch (this->mode) {
 		case CHANNEL_MODE_SYNC:
+			// senders waiting and not yet matched with a receiver
+			if (this->board[0].waiting <= this->board[0].permits) {
+				err = STATUS_BUSY;
+				goto onerror;
+			}
 			catch (board_receive(this->board));
 			response[0] = this->value;
 			--this->occupation;
 			break;
 		case CHANNEL_MODE_ASYNC:
-			while (this->occupation == 0) { // while empty
-				catch (condition_wait(&this->non_empty, &this->syncronized));
-			}
-
-			if (this->buffered) {
-				response[0] = fifo_get(&this->queue);
-			} else {
-				response[0] = this->value;
+		case CHANNEL_MODE_UNBOUNDED:
+			if (this->occupation == 0) {
+				err = STATUS_BUSY;
+				goto onerror;
 			}
+			response[0] = channel_fetch_(this);
 			--this->occupation;
 
 			catch (condition_signal(&this->non_full));
+			channel_notify_(this);
+			break;
+	}
+	if (this->occupation == 0) {
+		if (CHANNEL_CLOSED & this->flags) {
+			this->flags |= CHANNEL_DRY;
+		}
+	}
+	ASSERT_CHANNEL_INVARIANT
+
+	ENTRY_END
+}
+
+////////////////////////////////////////////////////////////////////////
+// Batched transfers
+////////////////////////////////////////////////////////////////////////
+
+/*
+ * Each monitor entry moves as many Scalars as fit, with a single wakeup
+ * for the batch. Syncronous and unbuffered channels still move one Scalar
+ * per rendezvous.
+ */
+
+static inline int
+channel_send_n_lockfree_ (Channel *const this, Scalar const scalars[], unsigned n)
+{
+	int err;
+
+	while (n > 0) {
+		unsigned k = 0;
+		while (k < n && channel_put_(this, scalars[k])) {
+			++k;
+		}
+		if (k == 0) { // full
+			catch (channel_park_sender_(this, CHANNEL_FOREVER));
+			continue;
+		}
+		scalars += k;
+		n -= k;
+		catch (channel_wake_(this, &this->receivers, &this->non_empty, k > 1));
+	}
+
+	return STATUS_SUCCESS;
+onerror:
+	return err;
+}
+
+static inline int
+channel_receive_n_lockfree_ (Channel *const this, Scalar response[], unsigned max, unsigned count[static 1])
+{
+	int err;
+	unsigned k = 0;
+
+	for (;;) {
+		while (k < max && channel_get_(this, &response[k])) {
+			++k;
+		}
+		if (k > 0) {
 			break;
+		}
+		if (CHANNEL_CLOSED & this->flags) {
+			if (channel_empty_(this)) {
+				this->flags |= CHANNEL_DRY;
+				count[0] = 0;
+				return STATUS_SUCCESS;
+			}
+			continue;
+		}
+		catch (channel_park_receiver_(this, CHANNEL_FOREVER));
+	}
+	if (CHANNEL_CLOSED & this->flags) {
+		if (channel_empty_(this)) {
+			this->flags |= CHANNEL_DRY;
+		}
+	}
+	count[0] = k;
+	catch (channel_wake_(this, &this->senders, &this->non_full, k > 1));
+
+	return STATUS_SUCCESS;
+onerror:
+	return err;
+}
+
+static inline int
+channel_send_n (Channel *const this, Scalar const scalars[], unsigned n)
+{
+	if (CHANNEL_CLOSED & this->flags) {
+		panic("cannot send to a closed channel");
+	}
+	if (channel_lockfree_(this)) {
+		return channel_send_n_lockfree_(this, scalars, n);
+	}
+	if (this->mode == CHANNEL_MODE_SYNC || !this->buffered) {
+		for (unsigned i = 0; i < n; ++i) {
+			int const err = channel_send(this, scalars[i]);
+			if (err != STATUS_SUCCESS) { return err; }
+		}
+		return STATUS_SUCCESS;
+	}
+
+	MONITOR_ENTRY
+
+	while (n > 0) {
+		while (this->occupation == this->capacity) { // while full
+			catch (condition_wait(&this->non_full, &this->syncronized));
+		}
+
+		unsigned const k = channel_store_n_(this, scalars, n);
+		if (k == 0) {
+			err = STATUS_NOMEM;
+			goto onerror;
+		}
+		this->occupation += k;
+		scalars += k;
+		n -= k;
+
+		catch (k == 1 ? condition_signal(&this->non_empty)
+		              : condition_broadcast(&this->non_empty));
+		channel_notify_(this);
+	}
+	ASSERT_CHANNEL_INVARIANT
+
+	ENTRY_END
+}
+
+/*
+ * Waits for at least one Scalar and receives up to `max`; `count` is 0
+ * only when the channel is dry.
+ */
+static inline int
+channel_receive_n (Channel *const this, Scalar response[], unsigned max, unsigned count[static 1])
+{
+	assert(max > 0);
+
+	if (CHANNEL_DRY & this->flags) {
+		count[0] = 0;
+		return STATUS_SUCCESS;
+	}
+	if (channel_lockfree_(this)) {
+		return channel_receive_n_lockfree_(this, response, max, count);
+	}
+	if (this->mode == CHANNEL_MODE_SYNC || !this->buffered) {
+		// not through `channel_receive`: a second dry check could return
+		// the dry marker as a value, and checking after the receive would
+		// miss the last value when its receive made the channel dry
+		count[0] = 1;
+		return channel_receive_locked_(this, response, CHANNEL_FOREVER);
+	}
+
+	MONITOR_ENTRY
+
+	while (this->occupation == 0) { // while empty
+		catch (condition_wait(&this->non_empty, &this->syncronized));
 	}
+
+	unsigned const k = channel_fetch_n_(this, response, max);
+	this->occupation -= k;
+	count[0] = k;
+
+	catch (k == 1 ? condition_signal(&this->non_full)
+	              : condition_broadcast(&this->non_full));
+	channel_notify_(this);
+
 	if (this->occupation == 0) {
 		if (CHANNEL_CLOSED & this->flags) {
 			this->flags |= CHANNEL_DRY;
@@ -245,6 +1043,143 @@ channel_receive (Channel *const this, Scalar response[static 1])
 	ENTRY_END
 }
 
+////////////////////////////////////////////////////////////////////////
+// Select
+////////////////////////////////////////////////////////////////////////
+
+/*
+ *  Alternative alts[] = {
+ *      ALT_RECEIVE(&c1),
+ *      ALT_RECEIVE(&c2, .guard=(n < 10)),
+ *      ALT_SEND(&c3, Signed(n)),
+ *  };
+ *  unsigned i;
+ *  catch (channel_select(3, alts, ms2ns(100), &i));
+ *  switch (i) {
+ *      case 0: ... alts[0].scalar ...
+ *      ...
+ *  }
+ *
+ * Returns STATUS_TIMEDOUT when no case is ready before `timeout` (for a
+ * zero timeout STATUS_BUSY), and STATUS_ERROR when all guards are false.
+ */
+
+static void
+channel_watch_ (Channel *const this, Alternative alt[static 1])
+{
+	lock_acquire(&this->syncronized);
+	alt->next_ = this->watchers;
+	this->watchers = alt;
+	if (channel_lockfree_(this)) {
+		// make the other side take the lock and notify
+		reg_add(alt->kind == ALT_KIND_SEND ? &this->senders : &this->receivers, 1, RELAXED);
+	}
+	lock_release(&this->syncronized);
+}
+
+static void
+channel_unwatch_ (Channel *const this, Alternative alt[static 1])
+{
+	lock_acquire(&this->syncronized);
+	Alternative** link = &this->watchers;
+	while (*link != alt) {
+		assert(*link != NULL);
+		link = &(*link)->next_;
+	}
+	*link = alt->next_;
+	alt->next_ = NULL;
+	if (channel_lockfree_(this)) {
+		reg_sub(alt->kind == ALT_KIND_SEND ? &this->senders : &this->receivers, 1, RELAXED);
+	}
+	lock_release(&this->syncronized);
+}
+
+static inline int
+channel_select (unsigned n, Alternative alts[static n], Clock timeout, unsigned chosen[static 1])
+{
+	// rotate the first case tried, so no channel is starved
+	static _Thread_local unsigned start_ = 0;
+	unsigned const start = start_++;
+	unsigned open = 0;
+
+	auto int attempt(void) {
+		open = 0;
+		for (unsigned j = 0; j < n; ++j) {
+			unsigned const i = (start + j) % n;
+			Alternative *const alt = &alts[i];
+			if (!alt->guard) { continue; }
+			++open;
+			int const err = (alt->kind == ALT_KIND_SEND)
+				? channel_try_send(alt->channel, alt->scalar)
+				: channel_try_receive(alt->channel, &alt->scalar);
+			if (err != STATUS_BUSY) {
+				chosen[0] = i;
+				return err;
+			}
+		}
+		return STATUS_BUSY;
+	}
+
+	int err = attempt();
+	if (err != STATUS_BUSY) { return err; }
+	if (open == 0)          { return STATUS_ERROR; }
+	if (timeout == 0)       { return STATUS_BUSY; }
+
+	Clock const deadline = now() + timeout;
+	Selector selector = { .fired = false };
+	catch (lock_init(&selector.syncronized));
+	if ((err=condition_init(&selector.queue)) != STATUS_SUCCESS) {
+		lock_destroy(&selector.syncronized);
+		return err;
+	}
+
+	for (unsigned i = 0; i < n; ++i) {
+		if (alts[i].guard) {
+			alts[i].selector_ = &selector;
+			channel_watch_(alts[i].channel, &alts[i]);
+		}
+	}
+	atomic_thread_fence(SEQ_CST);
+
+	for (;;) {
+		lock_acquire(&selector.syncronized); // `channel_notify_` sets it
+		selector.fired = false;
+		lock_release(&selector.syncronized);
+		if ((err=attempt()) != STATUS_BUSY) {
+			break;
+		}
+		lock_acquire(&selector.syncronized);
+		while (!selector.fired && err == STATUS_BUSY) {
+			if (timeout < 0) {
+				err = condition_wait(&selector.queue, &selector.syncronized);
+			} else {
+				Clock const t = deadline - now();
+				err = (t <= 0) ? STATUS_TIMEDOUT
+				    : condition_wait_for(&selector.queue, &selector.syncronized, t);
+			}
+			if (err == STATUS_SUCCESS || (err == STATUS_TIMEDOUT && selector.fired)) {
+				err = STATUS_BUSY;
+			}
+		}
+		lock_release(&selector.syncronized);
+		if (err != STATUS_BUSY) {
+			break;
+		}
+	}
+
+	for (unsigned i = 0; i < n; ++i) {
+		if (alts[i].guard) {
+			channel_unwatch_(alts[i].channel, &alts[i]);
+		}
+	}
+	condition_destroy(&selector.queue);
+	lock_destroy(&selector.syncronized);
+
+	return err;
+onerror:
+	return err;
+}
+
 #undef ASSERT_CHANNEL_INVARIANT
 
 #endif // vim:ai:sw=4:ts=4:syntax=cpp
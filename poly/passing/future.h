@@ -0,0 +1,296 @@
+#ifndef POLY_FUTURE_H
+#define POLY_FUTURE_H
+
+#ifndef POLY_H
+#include "../POLY.h"
+#endif
+#include "../atomics.h"
+#include "../scalar.h"
+#include "../monitor/_futex.h"
+
+//#include <stdlib.h>
+extern void  free(void*);
+extern void* malloc(size_t);
+
+/*
+ * One-shot futures: a single `Scalar` set once and read by any number of
+ * threads. The state is one atomic word, also used as futex: reading a set
+ * future touches no lock, and waiting sleeps on the word.
+ *
+ * Continuations registered with `future_then` or the combinators run when
+ * the future is set, in the setting thread, or at once in the registering
+ * thread if it is already set. They must not block.
+ */
+
+////////////////////////////////////////////////////////////////////////
+// Future interface
+////////////////////////////////////////////////////////////////////////
+
+typedef struct Future {
+	atomic(unsigned)            state;
+	Scalar                      value;
+	atomic(struct FutureThen_*) then; // pending continuations
+} Future;
+
+static int  future_init(Future *const this);
+static void future_destroy(Future *const this);
+static bool future_ready(Future const*const this);
+static int  future_set(Future *const this, Scalar value);
+static int  future_get(Future *const this, Scalar value[static 1]);
+static int  future_try_get(Future *const this, Scalar value[static 1]);
+static int  future_get_until(Future *const this, Scalar value[static 1], Clock deadline);
+static int  future_then(Future *const this, Future* next, Scalar map(Scalar));
+static int  future_when_all(Future *const this, unsigned n, Future* futures[static n]);
+static int  future_when_any(Future *const this, unsigned n, Future* futures[static n]);
+
+#define run_promise(T,F,...) \
+    run_thread(T, .future=(F) __VA_OPT__(,)__VA_ARGS__)
+
+////////////////////////////////////////////////////////////////////////
+// Future implementation
+////////////////////////////////////////////////////////////////////////
+
+enum {
+	FUTURE_CLAIMED_ = 1u<<0, // a setter is writing the value
+	FUTURE_READY_   = 1u<<1, // the value can be read
+	FUTURE_WAITERS_ = 1u<<2, // some thread sleeps on the state
+};
+
+#ifdef DEBUG
+#   define ASSERT_FUTURE_INVARIANT \
+        assert((LOAD(&this->state, RELAXED) & ~(FUTURE_CLAIMED_|FUTURE_READY_|FUTURE_WAITERS_)) == 0);
+#else
+#   define ASSERT_FUTURE_INVARIANT
+#endif
+
+// private: a continuation, fired once with the set future
+struct FutureThen_ {
+	struct FutureThen_* next;
+	void              (*fire)(struct FutureThen_* self, Future* source);
+	void*               target;
+	Scalar            (*map)(Scalar);
+};
+
+// `then` list once the continuations have been fired
+#define FUTURE_FIRED_ ((struct FutureThen_*)-1)
+
+static int
+future_init (Future *const this)
+{
+	STORE(&this->state, 0, RELAXED);
+	STORE(&this->then, NULL, RELAXED);
+	ASSERT_FUTURE_INVARIANT
+
+	return STATUS_SUCCESS;
+}
+
+// Continuations still pending are a client error
+static void
+future_destroy (Future *const this)
+{
+	struct FutureThen_ *const then = LOAD(&this->then, ACQUIRE);
+	assert(then == NULL || then == FUTURE_FIRED_);
+	(void)then;
+}
+
+static ALWAYS inline bool
+future_ready (Future const*const this)
+{
+	return (LOAD(&this->state, ACQUIRE) & FUTURE_READY_) != 0;
+}
+
+// Fire `then` in registration order
+static inline void
+future_fire_ (Future *const this, struct FutureThen_* then)
+{
+	struct FutureThen_* order = NULL;
+	while (then != NULL) {
+		struct FutureThen_ *const next = then->next;
+		then->next = order;
+		order = then;
+		then = next;
+	}
+	while (order != NULL) {
+		struct FutureThen_ *const next = order->next;
+		order->fire(order, this);
+		order = next;
+	}
+}
+
+// STATUS_BUSY if already set
+static int
+future_set (Future *const this, Scalar value)
+{
+	if ((reg_or(&this->state, FUTURE_CLAIMED_, ACQUIRE) & FUTURE_CLAIMED_) != 0) {
+		return STATUS_BUSY;
+	}
+	this->value = value;
+	if ((reg_or(&this->state, FUTURE_READY_, RELEASE) & FUTURE_WAITERS_) != 0) {
+		futex_wake(&this->state, INT_MAX);
+	}
+	ASSERT_FUTURE_INVARIANT
+
+	future_fire_(this, SWAP(&this->then, FUTURE_FIRED_, ACQ_REL));
+
+	return STATUS_SUCCESS;
+}
+
+static ALWAYS inline int
+future_try_get (Future *const this, Scalar value[static 1])
+{
+	if (!future_ready(this)) {
+		return STATUS_BUSY;
+	}
+	value[0] = this->value;
+	return STATUS_SUCCESS;
+}
+
+// Negative deadlines wait forever
+static int
+future_get_until (Future *const this, Scalar value[static 1], Clock deadline)
+{
+	unsigned state;
+	while (((state=LOAD(&this->state, ACQUIRE)) & FUTURE_READY_) == 0) {
+		if ((state & FUTURE_WAITERS_) == 0
+		 && !CAS(&this->state, &state, state|FUTURE_WAITERS_, RELAXED, RELAXED)) {
+			continue;
+		}
+		if (futex_wait(&this->state, state|FUTURE_WAITERS_, deadline) == STATUS_TIMEDOUT) {
+			if (future_ready(this)) { break; }
+			return STATUS_TIMEDOUT;
+		}
+	}
+	value[0] = this->value;
+
+	return STATUS_SUCCESS;
+}
+
+static ALWAYS inline int
+future_get (Future *const this, Scalar value[static 1])
+{
+	if (future_ready(this)) { // fast path
+		value[0] = this->value;
+		return STATUS_SUCCESS;
+	}
+	return future_get_until(this, value, -1);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Continuations
+////////////////////////////////////////////////////////////////////////
+
+// Push `then`, or fire it now if `this` is already set
+static inline void
+future_chain_ (Future *const this, struct FutureThen_* then)
+{
+	struct FutureThen_* head = LOAD(&this->then, ACQUIRE);
+	do {
+		if (head == FUTURE_FIRED_) {
+			then->next = NULL;
+			then->fire(then, this);
+			return;
+		}
+		then->next = head;
+	} while (!CASw(&this->then, &head, then, RELEASE, ACQUIRE));
+}
+
+static void
+future_then_fire_ (struct FutureThen_* self, Future* source)
+{
+	Future *const next = self->target;
+	Scalar const value = (self->map == NULL) ? source->value : self->map(source->value);
+	free(self);
+	future_set(next, value);
+}
+
+/*
+ * Set `next` to `map(value)` (or `value` if `map` is NULL) when `this` is
+ * set. `map` runs later in another thread: not a nested function.
+ */
+static inline int
+future_then (Future *const this, Future* next, Scalar map(Scalar))
+{
+	struct FutureThen_ *const then = malloc(sizeof(struct FutureThen_));
+	if (then == NULL) {
+		return STATUS_NOMEM;
+	}
+	then->fire = future_then_fire_;
+	then->target = next;
+	then->map = map;
+	future_chain_(this, then);
+
+	return STATUS_SUCCESS;
+}
+
+// private: shared by the continuations of a combinator
+struct FutureGroup_ {
+	atomic(unsigned)    remaining;
+	unsigned            size;
+	Future*             target;
+	struct FutureThen_  then[];
+};
+
+static void
+future_all_fire_ (struct FutureThen_* self, Future* source)
+{
+	(void)source;
+	struct FutureGroup_ *const group = self->target;
+	if (reg_sub(&group->remaining, 1, ACQ_REL) == 1) {
+		Future *const target = group->target;
+		unsigned const size = group->size;
+		free(group);
+		future_set(target, Unsigned(size));
+	}
+}
+
+static void
+future_any_fire_ (struct FutureThen_* self, Future* source)
+{
+	struct FutureGroup_ *const group = self->target;
+	future_set(group->target, Pointer(source)); // only the first succeeds
+	if (reg_sub(&group->remaining, 1, ACQ_REL) == 1) {
+		free(group);
+	}
+}
+
+static inline int
+future_group_ (Future *const this, unsigned n, Future* futures[static n], void fire(struct FutureThen_*, Future*))
+{
+	assert(n > 0);
+
+	struct FutureGroup_ *const group = malloc(sizeof(struct FutureGroup_) + n*sizeof(struct FutureThen_));
+	if (group == NULL) {
+		return STATUS_NOMEM;
+	}
+	STORE(&group->remaining, n, RELAXED);
+	group->size = n;
+	group->target = this;
+	for (unsigned i = 0; i < n; ++i) {
+		group->then[i].fire = fire;
+		group->then[i].target = group;
+		group->then[i].map = NULL;
+	}
+	for (unsigned i = 0; i < n; ++i) { // the group can be freed by the last one
+		future_chain_(futures[i], &group->then[i]);
+	}
+	return STATUS_SUCCESS;
+}
+
+// Set `this` to `Unsigned(n)` when all `futures` are set
+static inline int
+future_when_all (Future *const this, unsigned n, Future* futures[static n])
+{
+	return future_group_(this, n, futures, future_all_fire_);
+}
+
+// Set `this` to `Pointer(f)` when the first `f` of `futures` is set
+static inline int
+future_when_any (Future *const this, unsigned n, Future* futures[static n])
+{
+	return future_group_(this, n, futures, future_any_fire_);
+}
+
+#undef FUTURE_FIRED_
+#undef ASSERT_FUTURE_INVARIANT
+
+#endif // vim:ai:sw=4:ts=4:syntax=cpp
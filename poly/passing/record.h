@@ -0,0 +1,213 @@
+#ifndef POLY_RECORD_H
+#define POLY_RECORD_H
+
+#ifndef POLY_H
+#include "../POLY.h"
+#endif
+#include "../monitor/lock.h"
+#include "../monitor/condition.h"
+#include "../atomics.h"
+#include "_ring.h"
+
+//#include <string.h>
+extern void* memset(void*, int, size_t);
+
+/*
+ * Channels of fixed size records: like asyncronous channels, but messages
+ * are records of `size` bytes stored inline in the buffer, so values
+ * larger than a Scalar need no heap allocation per message.
+ */
+
+////////////////////////////////////////////////////////////////////////
+// RecordChannel interface
+////////////////////////////////////////////////////////////////////////
+
+typedef struct RecordChannel {
+	Lock      syncronized;
+	Condition non_empty;
+	Condition non_full;
+	atomic(unsigned) flags;
+	Ring      queue;
+} RecordChannel;
+
+static void record_channel_close(RecordChannel *const this);
+static void record_channel_destroy(RecordChannel *const this);
+static bool record_channel_dry(RecordChannel const*const this);
+static int  record_channel_init(RecordChannel *const this, unsigned capacity, unsigned size);
+static bool record_channel_ready(RecordChannel *const this);
+static int  record_channel_receive(RecordChannel *const this, void* record);
+static int  record_channel_send(RecordChannel *const this, void const* record);
+
+/*
+ * Typed variants:
+ *
+ *  struct Point { double x, y, z; };
+ *  RECORD_CHANNEL(PointChannel, point_channel, struct Point)
+ *
+ * defines the type `PointChannel` and the functions
+ *
+ *  point_channel_init(PointChannel*, unsigned capacity)
+ *  point_channel_send(PointChannel*, struct Point record)
+ *  point_channel_receive(PointChannel*, struct Point record[static 1])
+ *  point_channel_close, point_channel_destroy, point_channel_dry
+ */
+#define RECORD_CHANNEL(NAME,PREFIX,TYPE)                                  \
+typedef struct NAME { RecordChannel base; } NAME;                         \
+static ALWAYS inline int                                                  \
+PREFIX##_init (NAME *const this, unsigned capacity)                       \
+{ return record_channel_init(&this->base, capacity, sizeof(TYPE)); }      \
+static ALWAYS inline void                                                 \
+PREFIX##_destroy (NAME *const this)                                       \
+{ record_channel_destroy(&this->base); }                                  \
+static ALWAYS inline void                                                 \
+PREFIX##_close (NAME *const this)                                         \
+{ record_channel_close(&this->base); }                                    \
+static ALWAYS inline bool                                                 \
+PREFIX##_dry (NAME const*const this)                                      \
+{ return record_channel_dry(&this->base); }                               \
+static ALWAYS inline int                                                  \
+PREFIX##_send (NAME *const this, TYPE record)                             \
+{ return record_channel_send(&this->base, &record); }                     \
+static ALWAYS inline int                                                  \
+PREFIX##_receive (NAME *const this, TYPE record[static 1])                \
+{ return record_channel_receive(&this->base, record); }
+
+////////////////////////////////////////////////////////////////////////
+// RecordChannel implementation
+////////////////////////////////////////////////////////////////////////
+
+// Constants for flags
+enum { RECORD_CHANNEL_CLOSED=0x01, RECORD_CHANNEL_DRY=0x02 };
+
+#ifdef DEBUG
+#   define ASSERT_RECORD_CHANNEL_INVARIANT                   \
+        assert(!(RECORD_CHANNEL_DRY & this->flags)           \
+                || (RECORD_CHANNEL_CLOSED & this->flags));
+#else
+#   define ASSERT_RECORD_CHANNEL_INVARIANT
+#endif
+
+static int
+record_channel_init (RecordChannel *const this, unsigned capacity, unsigned size)
+{
+	assert(capacity > 0);
+	int err;
+
+	this->flags = 0;
+	if ((err=lock_init(&this->syncronized)) != STATUS_SUCCESS) {
+		return err;
+	}
+	catch (ring_init(&this->queue, capacity, size));
+	if ((err=condition_init(&this->non_empty)) != STATUS_SUCCESS) {
+		ring_destroy(&this->queue);
+		goto onerror;
+	}
+	if ((err=condition_init(&this->non_full)) != STATUS_SUCCESS) {
+		condition_destroy(&this->non_empty);
+		ring_destroy(&this->queue);
+		goto onerror;
+	}
+	ASSERT_RECORD_CHANNEL_INVARIANT
+
+	return STATUS_SUCCESS;
+onerror:
+	lock_destroy(&this->syncronized);
+	return err;
+}
+
+static void
+record_channel_destroy (RecordChannel *const this)
+{
+	assert(ring_empty(&this->queue));
+
+	condition_destroy(&this->non_full);
+	condition_destroy(&this->non_empty);
+	ring_destroy(&this->queue);
+	lock_destroy(&this->syncronized);
+}
+
+static inline void
+record_channel_close (RecordChannel *const this)
+{
+	lock_acquire(&this->syncronized);
+	this->flags |= RECORD_CHANNEL_CLOSED;
+	if (ring_empty(&this->queue)) {
+		this->flags |= RECORD_CHANNEL_DRY;
+	}
+	condition_broadcast(&this->non_empty); // let receivers see the closing
+	lock_release(&this->syncronized);
+}
+
+static ALWAYS inline bool
+record_channel_dry (RecordChannel const*const this)
+{
+	return (RECORD_CHANNEL_DRY & this->flags);
+}
+
+// A snapshot: other receivers can empty the channel right after
+static inline bool
+record_channel_ready (RecordChannel *const this)
+{
+	lock_acquire(&this->syncronized);
+	bool const ready = !ring_empty(&this->queue);
+	lock_release(&this->syncronized);
+	return ready;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+static int
+record_channel_send (RecordChannel *const this, void const* record)
+{
+	if (RECORD_CHANNEL_CLOSED & this->flags) {
+		panic("cannot send to a closed channel");
+	}
+
+	MONITOR_ENTRY
+
+	while (ring_full(&this->queue)) {
+		catch (condition_wait(&this->non_full, &this->syncronized));
+	}
+	ring_put(&this->queue, record);
+	catch (condition_signal(&this->non_empty));
+	ASSERT_RECORD_CHANNEL_INVARIANT
+
+	ENTRY_END
+}
+
+// On a dry channel the record is zeroed
+static int
+record_channel_receive (RecordChannel *const this, void* record)
+{
+	if (RECORD_CHANNEL_DRY & this->flags) {
+		memset(record, 0, ring_size(&this->queue));
+		return STATUS_SUCCESS;
+	}
+
+	MONITOR_ENTRY
+
+	while (ring_empty(&this->queue)) {
+		if (RECORD_CHANNEL_CLOSED & this->flags) {
+			this->flags |= RECORD_CHANNEL_DRY;
+			memset(record, 0, ring_size(&this->queue));
+			goto done;
+		}
+		catch (condition_wait(&this->non_empty, &this->syncronized));
+	}
+	ring_get(&this->queue, record);
+	catch (condition_signal(&this->non_full));
+
+	if (ring_empty(&this->queue)) {
+		if (RECORD_CHANNEL_CLOSED & this->flags) {
+			this->flags |= RECORD_CHANNEL_DRY;
+		}
+	}
+done:
+	ASSERT_RECORD_CHANNEL_INVARIANT
+
+	ENTRY_END
+}
+
+#undef ASSERT_RECORD_CHANNEL_INVARIANT
+
+#endif // vim:ai:sw=4:ts=4:syntax=cpp
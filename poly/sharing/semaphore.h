@@ -6,6 +6,7 @@
 #endif
 #include "../monitor/lock.h"
 #include "../monitor/condition.h"
+#include "../monitor/combiner.h"
 
 ////////////////////////////////////////////////////////////////////////
 // Interface
@@ -31,6 +32,25 @@ static int  semaphore_V(Semaphore *const this);
 #define     semaphore_down(s) semaphore_P(s)
 #define     semaphore_up(s) semaphore_V(s)
 
+/*
+ * A semaphore for many contending threads: P and V update `resources`
+ * through flat combining, and the lock and condition are used only to park
+ * the P that find no resources.
+ */
+typedef struct CombiningSemaphore {
+	Lock        syncronized;
+	Condition   queue;
+	signed      resources;
+	atomic(unsigned) epoch;    // bumped by each V
+	atomic(unsigned) sleepers; // # of P parked on `queue`
+	Combiner    combiner;
+} CombiningSemaphore;
+
+static void combining_semaphore_destroy(CombiningSemaphore *const this);
+static int  combining_semaphore_init(CombiningSemaphore *const this, unsigned count);
+static int  combining_semaphore_P(CombiningSemaphore *const this);
+static int  combining_semaphore_V(CombiningSemaphore *const this);
+
 ////////////////////////////////////////////////////////////////////////
 // Implementation
 ////////////////////////////////////////////////////////////////////////
@@ -79,6 +99,8 @@ semaphore_destroy (Semaphore *const this)
  * catch (semaphore_wait(&event));  ...; catch (semaphore_signal(&event));
  *
  * catch (semaphore_init(&allocator, N));
+ *
+ * catch (combining_semaphore_init(&allocator, N)); // hit by many threads
  */
 
 static int
@@ -107,6 +129,131 @@ semaphore_V (Semaphore *const this)
 	ENTRY_END
 }
 
+////////////////////////////////////////////////////////////////////////
+// Combining semaphore
+////////////////////////////////////////////////////////////////////////
+
+static int
+combining_semaphore_init (CombiningSemaphore *const this, unsigned count)
+{
+	this->resources = count;
+	STORE(&this->epoch, 0, RELAXED);
+	STORE(&this->sleepers, 0, RELAXED);
+
+	int err;
+	if ((err=(lock_init(&this->syncronized))) != STATUS_SUCCESS) {
+		return err;
+	}
+	if ((err=condition_init(&this->queue)) != STATUS_SUCCESS) {
+		lock_destroy(&this->syncronized);
+		return err;
+	}
+	if ((err=combiner_init(&this->combiner)) != STATUS_SUCCESS) {
+		condition_destroy(&this->queue);
+		lock_destroy(&this->syncronized);
+		return err;
+	}
+	ASSERT_SEMAPHORE_INVARIANT
+
+	return STATUS_SUCCESS;
+}
+
+static void
+combining_semaphore_destroy (CombiningSemaphore *const this)
+{
+	assert(this->resources == 0 ); // ???
+
+	combiner_destroy(&this->combiner);
+	condition_destroy(&this->queue);
+	lock_destroy(&this->syncronized);
+}
+
+// private: a combined P or V
+struct SemaphoreOperation_ {
+	CombiningSemaphore* semaphore;
+	bool                done;
+};
+
+static void
+combining_semaphore_down_ (void* data)
+{
+	struct SemaphoreOperation_ *const op = data;
+	CombiningSemaphore *const this = op->semaphore;
+
+	if ((op->done=(this->resources > 0))) {
+		--this->resources;
+	}
+	ASSERT_SEMAPHORE_INVARIANT
+}
+
+static void
+combining_semaphore_up_ (void* data)
+{
+	struct SemaphoreOperation_ *const op = data;
+	CombiningSemaphore *const this = op->semaphore;
+
+	++this->resources;
+	reg_add(&this->epoch, 1, RELEASE);
+	op->done = true;
+	ASSERT_SEMAPHORE_INVARIANT
+}
+
+// Sleep until some V after `epoch` (see `channel_park_receiver_`)
+static int
+combining_semaphore_park_ (CombiningSemaphore *const this, unsigned epoch)
+{
+	MONITOR_ENTRY
+
+	reg_add(&this->sleepers, 1, RELAXED);
+	atomic_thread_fence(SEQ_CST);
+	while (LOAD(&this->epoch, ACQUIRE) == epoch) {
+		if ((err=condition_wait(&this->queue, &this->syncronized)) != STATUS_SUCCESS) {
+			reg_sub(&this->sleepers, 1, RELAXED);
+			goto onerror;
+		}
+	}
+	reg_sub(&this->sleepers, 1, RELAXED);
+
+	ENTRY_END
+}
+
+static int
+combining_semaphore_P (CombiningSemaphore *const this)
+{
+	int err;
+	struct SemaphoreOperation_ op = { .semaphore=this };
+
+	for (;;) {
+		unsigned const epoch = LOAD(&this->epoch, ACQUIRE);
+		combiner_execute(&this->combiner, combining_semaphore_down_, &op);
+		if (op.done) {
+			break;
+		}
+		catch (combining_semaphore_park_(this, epoch));
+	}
+	return STATUS_SUCCESS;
+onerror:
+	return err;
+}
+
+static int
+combining_semaphore_V (CombiningSemaphore *const this)
+{
+	struct SemaphoreOperation_ op = { .semaphore=this };
+
+	combiner_execute(&this->combiner, combining_semaphore_up_, &op);
+	atomic_thread_fence(SEQ_CST);
+	if (LOAD(&this->sleepers, RELAXED) == 0) {
+		return STATUS_SUCCESS;
+	}
+
+	MONITOR_ENTRY
+
+	catch (condition_signal(&this->queue));
+
+	ENTRY_END
+}
+
 #undef ASSERT_SEMAPHORE_INVARIANT
 
 #endif // vim:ai:sw=4:ts=4:syntax=cpp
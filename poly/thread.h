@@ -4,9 +4,27 @@
 #ifndef POLY_H
 #include "POLY.h"
 #endif
+#include "atomics.h"
+
+#include <limits.h> // PTHREAD_STACK_MIN, visible with the feature macro of POLY.h
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//#include <stdlib.h>
+extern void  free(void*);
+extern void* malloc(size_t);
+// GNU extension of <pthread.h>
+extern int   pthread_cond_clockwait(pthread_cond_t*, pthread_mutex_t*, clockid_t, struct timespec const*);
 
 /*
  * A thin façade renaming on top of C11 type `thrd_t`.
+ *
+ * `thread_create_with` also takes attributes, applied with POSIX threads
+ * (`thrd_t` is a `pthread_t` in glibc).
  */
 
 ////////////////////////////////////////////////////////////////////////
@@ -24,6 +42,19 @@ static int      thread_join(Thread thread, int *const result);
 static int      thread_sleep(Clock duration);
 static void     thread_yield(void);
 
+enum { THREAD_CPU_WORDS=1024/(8*sizeof(unsigned long)) }; // as `cpu_set_t`
+
+typedef struct ThreadAttributes {
+	size_t          stack;    // bytes; 0 for the default
+	char const*     name;     // up to 15 characters; NULL for none
+	int             policy;   // SCHED_FIFO, SCHED_RR...; 0 inherits
+	int             priority; // for the policy
+	unsigned long   affinity[THREAD_CPU_WORDS]; // CPU mask; none for all
+} ThreadAttributes;
+
+static int      thread_create_with(Thread* this, ThreadAttributes const* attributes, int main(void*), void* argument);
+static void     thread_attributes_pin(ThreadAttributes *const this, unsigned cpu);
+
 ////////////////////////////////////////////////////////////////////////
 // Thread implementation
 ////////////////////////////////////////////////////////////////////////
@@ -67,10 +98,8 @@ thread_yield (void)
 static ALWAYS inline int
 thread_sleep (Clock duration)
 {
-	// Split `duration` nanoseconds to make an `struct timespec`
-	const time_t s  = ns2s(duration);
-	const long   ns = duration - s2ns(s);
-	return thrd_sleep(&(struct timespec){.tv_sec=s, .tv_nsec=ns}, NULL);
+	struct timespec const ts = ns2timespec(duration);
+	return thrd_sleep(&ts, NULL);
 }
 
 static ALWAYS inline void
@@ -79,33 +108,380 @@ thread_exit (int result)
 	thrd_exit(result);
 }
 
+////////////////////////////////////////////////////////////////////////
+// Thread attributes
+////////////////////////////////////////////////////////////////////////
+
+static_assert(sizeof(thrd_t) == sizeof(pthread_t));
+
+// Add `cpu` to the affinity mask
+static inline void
+thread_attributes_pin (ThreadAttributes *const this, unsigned cpu)
+{
+	assert(cpu < THREAD_CPU_WORDS*8*sizeof(unsigned long));
+
+	this->affinity[cpu / (8*sizeof(unsigned long))] |= 1ul << (cpu % (8*sizeof(unsigned long)));
+}
+
+// private: what the new thread applies to itself before running `main`
+struct ThreadLaunch_ {
+	int           (*main)(void*);
+	void*           argument;
+	bool            pinned;
+	unsigned long   affinity[THREAD_CPU_WORDS];
+	char            name[16];
+};
+
+static void*
+thread_launch_ (void* data)
+{
+	struct ThreadLaunch_ const launch = *(struct ThreadLaunch_*)data;
+	free(data);
+
+	// best effort: failures leave the thread unpinned or unnamed
+	if (launch.pinned) {
+		syscall(SYS_sched_setaffinity, 0, sizeof(launch.affinity), launch.affinity);
+	}
+	if (launch.name[0] != '\0') {
+		prctl(PR_SET_NAME, launch.name);
+	}
+	return (void*)(intptr_t)launch.main(launch.argument); // see `thrd_join`
+}
+
+// As `thread_create`; `attributes` can be NULL
+static inline int
+thread_create_with (Thread* this, ThreadAttributes const* attributes, int main(void*), void* argument)
+{
+	if (attributes == NULL) {
+		return thread_create(this, main, argument);
+	}
+
+	struct ThreadLaunch_ *const launch = malloc(sizeof(struct ThreadLaunch_));
+	if (launch == NULL) {
+		return STATUS_NOMEM;
+	}
+	launch->main = main;
+	launch->argument = argument;
+	launch->pinned = false;
+	for (unsigned i = 0; i < THREAD_CPU_WORDS; ++i) {
+		launch->affinity[i] = attributes->affinity[i];
+		launch->pinned |= (attributes->affinity[i] != 0);
+	}
+	unsigned n = 0;
+	if (attributes->name != NULL) {
+		for (; n < sizeof(launch->name)-1 && attributes->name[n] != '\0'; ++n) {
+			launch->name[n] = attributes->name[n];
+		}
+	}
+	launch->name[n] = '\0';
+
+	pthread_attr_t attr;
+	int err;
+	if ((err=pthread_attr_init(&attr)) != 0) {
+		free(launch);
+		return STATUS_NOMEM;
+	}
+	if (attributes->stack != 0) {
+		// a sysconf() call since glibc 2.34: evaluate once
+		size_t const minimum = PTHREAD_STACK_MIN;
+		size_t const stack = attributes->stack < minimum ? minimum : attributes->stack;
+		err = pthread_attr_setstacksize(&attr, stack);
+	}
+	if (err == 0 && attributes->policy != SCHED_OTHER) {
+		struct sched_param const param = { .sched_priority = attributes->priority };
+		if ((err=pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED)) == 0
+		 && (err=pthread_attr_setschedpolicy(&attr, attributes->policy)) == 0) {
+			err = pthread_attr_setschedparam(&attr, &param);
+		}
+	}
+	if (err == 0) {
+		err = pthread_create((pthread_t*)this, &attr, thread_launch_, launch);
+	}
+	pthread_attr_destroy(&attr);
+
+	switch (err) {
+		case 0:
+			return STATUS_SUCCESS;
+		case EAGAIN:
+		case ENOMEM:
+			free(launch);
+			return STATUS_NOMEM;
+		default: // EINVAL, EPERM (real time policies)...
+			free(launch);
+			return STATUS_ERROR;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////
+// Startup handshake
+////////////////////////////////////////////////////////////////////////
+
+#ifdef __linux__
+#include "monitor/_futex.h"
+#endif
+
+// private: shared by a parent and the threads it starts
+struct ThreadStart_ {
+	atomic(unsigned) pending; // # of threads yet to copy their arguments
+};
+
+// Child side: arguments copied (`start` is NULL for pooled bodies)
+static ALWAYS inline void
+thread_started_ (struct ThreadStart_* start)
+{
+	if (start == NULL) { return; }
+#ifdef __linux__
+	if (reg_sub(&start->pending, 1, RELEASE) == 1) {
+		futex_wake(&start->pending, 1);
+	}
+#else
+	reg_sub(&start->pending, 1, RELEASE);
+#endif
+}
+
+// Parent side: sleep until all children have copied their arguments
+static inline void
+thread_start_wait_ (struct ThreadStart_* start)
+{
+	unsigned pending;
+	while ((pending=LOAD(&start->pending, ACQUIRE)) != 0) {
+#ifdef __linux__
+		futex_wait(&start->pending, pending, -1);
+#else
+		thread_yield();
+#endif
+	}
+}
+
 ////////////////////////////////////////////////////////////////////////
 // Ada style
 ////////////////////////////////////////////////////////////////////////
 
 // Thread_ID: 0, 1, ... (0 reserved to main)
-static _Thread_local unsigned   Thread_ID = 0;
+static _Thread_local unsigned   Thread_ID __attribute__((unused)) = 0;
 // private atomic global counter (provide unique IDs)
-static _Atomic unsigned         THREAD_ID_COUNT_ = 1;
+static _Atomic unsigned         THREAD_ID_COUNT_ __attribute__((unused)) = 1;
+// private flag: bodies run as jobs on pool threads, not to be detached
+static _Thread_local bool       THREAD_POOLED_ = false;
 
 #define THREAD_TYPE \
-        atomic(bool) initialized_;
+        struct ThreadStart_* started_;
 
 #define THREAD_BODY(T,D)                       \
         struct T const this = *((struct T*)D); \
-        ((struct T*)D)->initialized_ = true;   \
+        thread_started_(this.started_);        \
         Thread_ID = THREAD_ID_COUNT_++;        \
-        thread_detach(thread_current());
+        if (!THREAD_POOLED_) thread_detach(thread_current());
 
 #define END_BODY                \
         return STATUS_SUCCESS;  \
 
 #define run_thread(T,...)                                     \
 do {                                                          \
-    struct T data_ = {__VA_ARGS__};                           \
-    int const err_ = thread_create(&(Thread){0}, T, &data_);  \
+    struct ThreadStart_ start_ = {1};                         \
+    struct T data_ = {.started_=&start_, __VA_ARGS__};        \
+    int const err_ = thread_spawn_(T, &data_);                \
     if (err_ != STATUS_SUCCESS) panic("cannot start thread"); \
-    while (!data_.initialized_) thread_yield();               \
+    thread_start_wait_(&start_);                              \
 } while (0)
 
+/*
+ *  ThreadAttributes a = { .stack=64*1024, .name="stage" };
+ *  thread_attributes_pin(&a, 3);
+ *  run_thread_with(&a, T, .a=1, .b=2);
+ */
+#define run_thread_with(A,T,...)                                           \
+do {                                                                       \
+    struct ThreadStart_ start_ = {1};                                      \
+    struct T data_ = {.started_=&start_, __VA_ARGS__};                     \
+    int const err_ = thread_create_with(&(Thread){0}, (A), T, &data_);     \
+    if (err_ != STATUS_SUCCESS) panic("cannot start thread");              \
+    thread_start_wait_(&start_);                                           \
+} while (0)
+
+/*
+ *  struct T stages[N] = {...};
+ *  run_threads(T, N, stages); // `stages` can be reused on return
+ */
+#define run_threads(T,N,A)                                        \
+do {                                                              \
+    unsigned const n_ = (N);                                      \
+    struct ThreadStart_ start_ = {n_};                            \
+    for (unsigned i_ = 0; i_ < n_; ++i_) {                        \
+        (A)[i_].started_ = &start_;                               \
+        int const err_ = thread_spawn_(T, &(A)[i_]);              \
+        if (err_ != STATUS_SUCCESS) panic("cannot start thread"); \
+    }                                                             \
+    thread_start_wait_(&start_);                                  \
+} while (0)
+
+////////////////////////////////////////////////////////////////////////
+// Thread cache
+////////////////////////////////////////////////////////////////////////
+
+/*
+ * `run_thread` and `run_threads` bodies run on cached detached threads: a
+ * thread whose body returns waits up to a timeout for the next body before
+ * exiting, and at most a given number of threads wait at the same time.
+ * Thread locals set by a body can be seen by the next body on the thread.
+ */
+
+#ifndef POLY_THREAD_CACHE_SIZE
+#define POLY_THREAD_CACHE_SIZE      32        // idle threads kept
+#endif
+#ifndef POLY_THREAD_CACHE_TIMEOUT
+#define POLY_THREAD_CACHE_TIMEOUT   s2ns(2)   // before an idle thread exits
+#endif
+
+static void thread_cache_limits(unsigned size, Clock timeout);
+
+// private: a cached thread, allocated by the thread that creates it
+struct ThreadCached_ {
+	struct ThreadCached_* next;  // idle stack link
+	cnd_t                 wake;
+	int                 (*main)(void*); // NULL while idle
+	void*                 argument;
+};
+
+static struct ThreadCache_ {
+	mtx_t                 lock;
+	struct ThreadCached_* idle;  // most recently idle first
+	unsigned              count; // # of idle threads
+	unsigned              size;
+	Clock                 timeout;
+} THREAD_CACHE_;
+
+static once_flag THREAD_CACHE_ONCE_ = ONCE_FLAG_INIT;
+
+static void
+thread_cache_init_ (void)
+{
+	if (mtx_init(&THREAD_CACHE_.lock, mtx_plain) != STATUS_SUCCESS) {
+		panic("cannot initialize the thread cache");
+	}
+	THREAD_CACHE_.idle = NULL;
+	THREAD_CACHE_.count = 0;
+	THREAD_CACHE_.size = POLY_THREAD_CACHE_SIZE;
+	THREAD_CACHE_.timeout = POLY_THREAD_CACHE_TIMEOUT;
+}
+
+// `size` == 0 disables the cache
+static inline void
+thread_cache_limits (unsigned size, Clock timeout)
+{
+	assert(timeout >= 0);
+	call_once(&THREAD_CACHE_ONCE_, thread_cache_init_);
+
+	mtx_lock(&THREAD_CACHE_.lock);
+	THREAD_CACHE_.size = size;
+	THREAD_CACHE_.timeout = timeout;
+	while (THREAD_CACHE_.count > size) { // expire the oldest idle threads
+		struct ThreadCached_** link = &THREAD_CACHE_.idle;
+		while ((*link)->next != NULL) {
+			link = &(*link)->next;
+		}
+		struct ThreadCached_ *const self = *link;
+		*link = NULL;
+		--THREAD_CACHE_.count;
+		self->next = self; // mark: exit
+		cnd_signal(&self->wake);
+	}
+	mtx_unlock(&THREAD_CACHE_.lock);
+}
+
+// Wait for the next body; false if the thread must exit
+static inline bool
+thread_cache_park_ (struct ThreadCached_ *const self)
+{
+	struct ThreadCache_ *const this = &THREAD_CACHE_;
+
+	mtx_lock(&this->lock);
+	if (this->count >= this->size) {
+		mtx_unlock(&this->lock);
+		return false;
+	}
+	self->main = NULL;
+	self->next = this->idle;
+	this->idle = self;
+	++this->count;
+
+	Clock const deadline = now() + this->timeout;
+	struct timespec const ts = ns2timespec(deadline);
+	while (self->main == NULL && self->next != self) {
+		// glibc `cnd_t` and `mtx_t` wrap the pthread types; wait on the monotonic clock
+		int const e = pthread_cond_clockwait((pthread_cond_t*)&self->wake, (pthread_mutex_t*)&this->lock, CLOCK_MONOTONIC, &ts);
+		if (e == ETIMEDOUT && self->main == NULL) {
+			if (self->next != self) { // still in the stack: unlink
+				struct ThreadCached_** link = &this->idle;
+				while (*link != self) {
+					link = &(*link)->next;
+				}
+				*link = self->next;
+				--this->count;
+			}
+			break;
+		}
+	}
+	mtx_unlock(&this->lock);
+
+	return self->main != NULL;
+}
+
+static int
+thread_cache_worker_ (void* data)
+{
+	struct ThreadCached_ *const self = data;
+	THREAD_POOLED_ = true;
+	thread_detach(thread_current());
+
+	do {
+		self->main(self->argument);
+	} while (thread_cache_park_(self));
+
+	cnd_destroy(&self->wake);
+	free(self);
+	return STATUS_SUCCESS;
+}
+
+// Run `main(argument)` on an idle cached thread, or on a new one
+static inline int
+thread_spawn_ (int main(void*), void* argument)
+{
+	struct ThreadCache_ *const this = &THREAD_CACHE_;
+	call_once(&THREAD_CACHE_ONCE_, thread_cache_init_);
+
+	mtx_lock(&this->lock);
+	struct ThreadCached_ *const idle = this->idle;
+	if (idle != NULL) {
+		this->idle = idle->next;
+		--this->count;
+		idle->next = NULL;
+		idle->main = main;
+		idle->argument = argument;
+		cnd_signal(&idle->wake);
+		mtx_unlock(&this->lock);
+		return STATUS_SUCCESS;
+	}
+	mtx_unlock(&this->lock);
+
+	struct ThreadCached_ *const self = malloc(sizeof(struct ThreadCached_));
+	if (self == NULL) {
+		return STATUS_NOMEM;
+	}
+	self->next = NULL;
+	self->main = main;
+	self->argument = argument;
+	int err;
+	if ((err=cnd_init(&self->wake)) != STATUS_SUCCESS) {
+		free(self);
+		return err;
+	}
+	if ((err=thread_create(&(Thread){0}, thread_cache_worker_, self)) != STATUS_SUCCESS) {
+		cnd_destroy(&self->wake);
+		free(self);
+		return err;
+	}
+	return STATUS_SUCCESS;
+}
+
 #endif // vim:ai:sw=4:ts=4:syntax=cpp
@@ -0,0 +1,388 @@
+#ifndef POLY_TIMER_H
+#define POLY_TIMER_H
+
+#ifndef POLY_H
+#include "POLY.h"
+#endif
+#include "atomics.h"
+#include "thread.h"
+#include "monitor/_futex.h"
+
+/*
+ * Hierarchical timer wheel (after Varghese and Lauck, as in old Linux
+ * kernels) served by one thread: 4 levels of 64 slots, the first one of
+ * `resolution` ticks. Timers are intrusive, so starting and cancelling are
+ * O(1) and allocate nothing. Callbacks run in the service thread, with the
+ * wheel unlocked, and must not block.
+ *
+ * With `POLY_TIMER_WHEEL` defined, timed waits on conditions (and so timed
+ * channel, notice and entry operations) are woken by the default wheel
+ * instead of each one arming a kernel timer.
+ */
+
+////////////////////////////////////////////////////////////////////////
+// Timer interface
+////////////////////////////////////////////////////////////////////////
+
+#ifndef POLY_TIMER_RESOLUTION
+#define POLY_TIMER_RESOLUTION   ms2ns(1) // default tick
+#endif
+
+enum { TIMER_LEVELS=4, TIMER_BITS=6, TIMER_SLOTS=1<<TIMER_BITS };
+
+typedef struct Timer {
+	struct Timer*       next;
+	struct Timer**      link;     // to this timer in its list; NULL if idle
+	Clock               deadline; // next expiration (`now()` time point)
+	Clock               period;   // 0 for one-shot timers
+	Clock               expires;  // deadline tick
+	void              (*callback)(void*);
+	void*               argument;
+} Timer;
+
+typedef struct TimerWheel {
+	mtx_t               lock;
+	Timer*              slot[TIMER_LEVELS][TIMER_SLOTS];
+	Timer*              due;      // expired, callbacks not run yet
+	Clock               resolution;
+	Clock               current;  // last tick processed
+	Clock               wakeup;   // tick the service thread sleeps until (-1: none)
+	unsigned            count;    // # of timers in slots
+	Timer*              running;  // callback in progress
+	unsigned            cancelling; // # of threads waiting for `running`
+	atomic(unsigned)    kick;     // futex: wakes the service thread
+	atomic(unsigned)    fired;    // futex: bumped after each callback
+	bool                stopping;
+	Thread              thread;
+} TimerWheel;
+
+static int          timer_wheel_init(TimerWheel *const this, Clock resolution);
+static void         timer_wheel_destroy(TimerWheel *const this);
+static TimerWheel*  timer_wheel_default(void);
+
+static void         timer_init(Timer *const this, void callback(void*), void* argument);
+static bool         timer_pending(Timer const*const this);
+static void         timer_start(TimerWheel *const wheel, Timer *const this, Clock deadline, Clock period);
+static bool         timer_cancel(TimerWheel *const wheel, Timer *const this);
+static int          timer_sleep(TimerWheel *const wheel, Clock duration);
+
+////////////////////////////////////////////////////////////////////////
+// Timer implementation
+////////////////////////////////////////////////////////////////////////
+
+static ALWAYS inline void
+timer_init (Timer *const this, void callback(void*), void* argument)
+{
+	this->next = NULL;
+	this->link = NULL;
+	this->callback = callback;
+	this->argument = argument;
+}
+
+static ALWAYS inline bool
+timer_pending (Timer const*const this)
+{
+	return this->link != NULL;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+static ALWAYS inline void
+timer_link_ (Timer** list, Timer* timer)
+{
+	timer->next = *list;
+	timer->link = list;
+	if (*list != NULL) {
+		(*list)->link = &timer->next;
+	}
+	*list = timer;
+}
+
+static ALWAYS inline void
+timer_unlink_ (Timer* timer)
+{
+	*timer->link = timer->next;
+	if (timer->next != NULL) {
+		timer->next->link = timer->link;
+	}
+	timer->next = NULL;
+	timer->link = NULL;
+}
+
+/*
+ * Put `timer` in the slot of its level (wheel locked). Due timers go to the
+ * slot of `current` when cascading, which is handled right after, and to
+ * the next one otherwise (slot `current` is already done).
+ */
+static inline void
+timer_insert_ (TimerWheel *const this, Timer* timer, bool cascading)
+{
+	Clock const horizon = (Clock)1 << (TIMER_BITS*TIMER_LEVELS);
+	Clock const delta = timer->expires - this->current;
+
+	Clock tick;
+	unsigned level = 0;
+	if (delta <= 0) { // due or overdue
+		tick = cascading ? this->current : this->current + 1;
+	} else {
+		tick = (delta < horizon) ? timer->expires : this->current + horizon-1;
+		Clock const d = tick - this->current;
+		while (level < TIMER_LEVELS-1 && d >= (Clock)1 << (TIMER_BITS*(level+1))) {
+			++level;
+		}
+	}
+	timer_link_(&this->slot[level][(tick >> (TIMER_BITS*level)) & (TIMER_SLOTS-1)], timer);
+	++this->count;
+}
+
+// Reinsert the timers of a slot from a higher level
+static inline void
+timer_cascade_ (TimerWheel *const this, unsigned level)
+{
+	Timer** const slot = &this->slot[level][(this->current >> (TIMER_BITS*level)) & (TIMER_SLOTS-1)];
+	Timer* timer = *slot;
+	*slot = NULL;
+	while (timer != NULL) {
+		Timer *const next = timer->next;
+		--this->count;
+		timer_insert_(this, timer, true);
+		timer = next;
+	}
+}
+
+// Move ticks up to `target` on, collecting expired timers in `due`
+static inline void
+timer_advance_ (TimerWheel *const this, Clock target)
+{
+	while (this->current < target && this->count != 0) {
+		++this->current;
+		for (unsigned level = 1; level < TIMER_LEVELS; ++level) {
+			if ((this->current & (((Clock)1 << (TIMER_BITS*level)) - 1)) != 0) {
+				break;
+			}
+			timer_cascade_(this, level);
+		}
+		Timer** const slot = &this->slot[0][this->current & (TIMER_SLOTS-1)];
+		while (*slot != NULL) {
+			Timer *const timer = *slot;
+			timer_unlink_(timer);
+			--this->count;
+			timer_link_(&this->due, timer);
+		}
+	}
+	if (this->current < target) { // empty wheel
+		this->current = target;
+	}
+}
+
+// Tick to wake up at: the next busy first level slot, or the next cascade
+static inline Clock
+timer_next_ (TimerWheel const*const this)
+{
+	if (this->count == 0) {
+		return -1;
+	}
+	Clock tick = this->current + 1;
+	while ((tick & (TIMER_SLOTS-1)) != 0 && this->slot[0][tick & (TIMER_SLOTS-1)] == NULL) {
+		++tick;
+	}
+	return tick;
+}
+
+static int
+timer_wheel_run_ (void* data)
+{
+	TimerWheel *const this = data;
+
+	mtx_lock(&this->lock);
+	while (!this->stopping) {
+		timer_advance_(this, now() / this->resolution);
+
+		Timer* timer;
+		while ((timer=this->due) != NULL) {
+			timer_unlink_(timer);
+			if (timer->period > 0) { // rearm before running
+				timer->deadline += timer->period;
+				timer->expires = (timer->deadline + this->resolution-1) / this->resolution;
+				timer_insert_(this, timer, false);
+			}
+			this->running = timer;
+			mtx_unlock(&this->lock);
+			timer->callback(timer->argument);
+			mtx_lock(&this->lock);
+			this->running = NULL;
+			if (this->cancelling != 0) {
+				reg_add(&this->fired, 1, RELEASE);
+				futex_wake(&this->fired, INT_MAX);
+			}
+		}
+
+		Clock const wakeup = this->wakeup = timer_next_(this);
+		unsigned const kick = LOAD(&this->kick, RELAXED);
+		mtx_unlock(&this->lock);
+		futex_wait(&this->kick, kick, (wakeup < 0) ? -1 : wakeup*this->resolution);
+		mtx_lock(&this->lock);
+	}
+	mtx_unlock(&this->lock);
+
+	return STATUS_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+// `resolution` == 0 means POLY_TIMER_RESOLUTION
+static int
+timer_wheel_init (TimerWheel *const this, Clock resolution)
+{
+	int err;
+
+	this->resolution = (resolution > 0) ? resolution : POLY_TIMER_RESOLUTION;
+	for (unsigned i = 0; i < TIMER_LEVELS; ++i) {
+		for (unsigned j = 0; j < TIMER_SLOTS; ++j) {
+			this->slot[i][j] = NULL;
+		}
+	}
+	this->due = NULL;
+	this->current = now() / this->resolution;
+	this->wakeup = -1;
+	this->count = 0;
+	this->running = NULL;
+	this->cancelling = 0;
+	STORE(&this->kick, 0, RELAXED);
+	STORE(&this->fired, 0, RELAXED);
+	this->stopping = false;
+
+	catch (mtx_init(&this->lock, mtx_plain));
+	if ((err=thread_create(&this->thread, timer_wheel_run_, this)) != STATUS_SUCCESS) {
+		mtx_destroy(&this->lock);
+		goto onerror;
+	}
+	return STATUS_SUCCESS;
+onerror:
+	return err;
+}
+
+// Pending timers are dropped
+static inline void
+timer_wheel_destroy (TimerWheel *const this)
+{
+	mtx_lock(&this->lock);
+	this->stopping = true;
+	reg_add(&this->kick, 1, RELAXED);
+	mtx_unlock(&this->lock);
+	futex_wake(&this->kick, 1);
+
+	thread_join(this->thread, NULL);
+	mtx_destroy(&this->lock);
+}
+
+static TimerWheel  TIMER_WHEEL_;
+static once_flag   TIMER_WHEEL_ONCE_ = ONCE_FLAG_INIT;
+
+static void
+timer_wheel_default_init_ (void)
+{
+	if (timer_wheel_init(&TIMER_WHEEL_, 0) != STATUS_SUCCESS) {
+		panic("cannot start the timer wheel");
+	}
+}
+
+// Started on first use, never stopped
+static inline TimerWheel*
+timer_wheel_default (void)
+{
+	call_once(&TIMER_WHEEL_ONCE_, timer_wheel_default_init_);
+	return &TIMER_WHEEL_;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+/*
+ * Run the callback at `deadline` (a `now()` time point), and then every
+ * `period` nanoseconds if `period` > 0. Restarts pending timers.
+ */
+static void
+timer_start (TimerWheel *const wheel, Timer *const this, Clock deadline, Clock period)
+{
+	assert(period >= 0);
+
+	mtx_lock(&wheel->lock);
+	if (this->link != NULL) {
+		bool const due = (this->link == &wheel->due);
+		timer_unlink_(this);
+		if (!due) { --wheel->count; }
+	}
+	if (wheel->count == 0) { // the service thread may have slept long
+		wheel->current = now() / wheel->resolution;
+	}
+	this->deadline = deadline;
+	this->period = period;
+	this->expires = (deadline + wheel->resolution-1) / wheel->resolution;
+	timer_insert_(wheel, this, false);
+
+	bool const kick = (wheel->wakeup < 0 || this->expires < wheel->wakeup);
+	if (kick) {
+		reg_add(&wheel->kick, 1, RELAXED);
+	}
+	mtx_unlock(&wheel->lock);
+	if (kick) {
+		futex_wake(&wheel->kick, 1);
+	}
+}
+
+/*
+ * Returns whether the timer was pending. When called out of the service
+ * thread, a callback of this timer in progress has finished on return.
+ */
+static bool
+timer_cancel (TimerWheel *const wheel, Timer *const this)
+{
+	mtx_lock(&wheel->lock);
+	bool const pending = (this->link != NULL);
+	if (pending) {
+		bool const due = (this->link == &wheel->due);
+		timer_unlink_(this);
+		if (!due) { --wheel->count; }
+	}
+	if (wheel->running == this && !thread_equal(thread_current(), wheel->thread)) {
+		++wheel->cancelling;
+		do {
+			unsigned const fired = LOAD(&wheel->fired, RELAXED);
+			mtx_unlock(&wheel->lock);
+			futex_wait(&wheel->fired, fired, -1);
+			mtx_lock(&wheel->lock);
+		} while (wheel->running == this);
+		--wheel->cancelling;
+	}
+	mtx_unlock(&wheel->lock);
+
+	return pending;
+}
+
+// The alarm of `timer_sleep`
+static void
+timer_ring_ (void* argument)
+{
+	atomic(unsigned) *const rung = argument;
+	STORE(rung, 1, RELEASE);
+	futex_wake(rung, 1);
+}
+
+// Sleep `duration` nanoseconds, woken by `wheel`
+static inline int
+timer_sleep (TimerWheel *const wheel, Clock duration)
+{
+	atomic(unsigned) rung = 0;
+
+	Timer alarm;
+	timer_init(&alarm, timer_ring_, &rung);
+	timer_start(wheel, &alarm, now() + duration, 0);
+	while (LOAD(&rung, ACQUIRE) == 0) {
+		futex_wait(&rung, 0, -1);
+	}
+	timer_cancel(wheel, &alarm); // the callback may still be in `futex_wake`
+
+	return STATUS_SUCCESS;
+}
+
+#endif // vim:ai:sw=4:ts=4:syntax=cpp
@@ -2,11 +2,11 @@
 // gcc -Wall -O2 filename.c
 #pragma GCC diagnostic ignored "-Wunused-function"
 
-#include <stdio.h>
-
 #define DEBUG
 #include "poly/scalar.h"
 
+#include <stdio.h>
+
 #include "poly/passing/interface.h"
 
 typedef struct {
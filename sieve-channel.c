@@ -3,15 +3,15 @@
 
 #pragma GCC diagnostic ignored "-Wunused-function"
 
-#include <stdio.h>
-#include <stdlib.h>
-
 // comment next line to disable assertions
 #define DEBUG
 #include "poly/thread.h"
 #include "poly/scalar.h"
 #include "poly/passing/channel.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+
 ////////////////////////////////////////////////////////////////////////
 // Generate 2,3,5,7,9...
 ////////////////////////////////////////////////////////////////////////
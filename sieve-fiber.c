@@ -0,0 +1,113 @@
+// Sieve with one fiber for each prime
+// gcc -Wall -O2 -lpthread sieve-fiber.c
+
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+// comment next line to disable assertions
+#define DEBUG
+#define POLY_FIBERS
+#include "poly/fiber.h"
+#include "poly/scalar.h"
+#include "poly/passing/channel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+////////////////////////////////////////////////////////////////////////
+// Generate 2,3,5,7,9...
+////////////////////////////////////////////////////////////////////////
+
+struct Candidates {
+	THREAD_TYPE
+	Channel* input;
+	Channel* output;
+};
+
+int Candidates(void* data)
+{
+	THREAD_BODY (Candidates, data)
+
+	assert(this.input == NULL);
+
+	int n = 2;
+	channel_send(this.output, (Signed)n);
+
+	for (n=3; true; n+=2)  {
+		channel_send(this.output, (Signed)n);
+	}
+	END_BODY
+}
+
+////////////////////////////////////////////////////////////////////////
+// Filter multiples of `this->prime`
+////////////////////////////////////////////////////////////////////////
+
+struct Sieve {
+	THREAD_TYPE
+	Channel* input;
+	Channel* output;
+	int      prime;
+};
+
+int Sieve(void* data)
+{
+	THREAD_BODY (Sieve, data)
+
+	inline ALWAYS bool divides(int n) {
+		return n%this.prime == 0;
+	}
+	for (;;) {
+		Scalar s;
+		channel_receive(this.input, &s);
+		if (!divides(cast(s, int))) {
+			channel_send(this.output, s);
+		}
+	}
+	END_BODY
+}
+
+////////////////////////////////////////////////////////////////////////
+// Start generator and successive filters
+////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char* argv[argc+1])
+{
+	int err = 0;
+
+	enum { NPRIMES=100 };
+	int n = (argc == 1) ? NPRIMES : atoi(argv[1]);
+	if (n <= 0) n = NPRIMES; // ignore bad parameter
+
+	Channel _chn_arena[n+1], *_chn_ptr=_chn_arena;
+	inline Channel* alloc(void) { return _chn_ptr++; }
+
+	Scheduler scheduler;
+	err = scheduler_init(&scheduler, 0, 0);
+	assert(err == 0);
+
+	enum { syncronous=0, asyncronous=1 };
+	Channel* input = alloc();
+	channel_init(input, asyncronous);
+	run_fiber_filter(&scheduler, Candidates, NULL, input);
+	assert(err == 0);
+
+	for (int i=1; i <= n; ++i) {
+		Scalar s;
+		channel_receive(input, &s);
+		int prime = cast(s, int);
+
+		Channel* output = alloc();
+		channel_init(output, asyncronous);
+		run_fiber_filter(&scheduler, Sieve, input, output, .prime=prime);
+		assert(err == 0);
+
+		printf("%4d%c", prime, (i%10==0 ? '\n' : ' '));
+
+		input = output;
+	}
+	putchar('\n');
+
+	return 0;
+}
+
+// vim:ai:sw=4:ts=4:syntax=cpp
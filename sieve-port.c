@@ -4,15 +4,15 @@
 #pragma GCC diagnostic ignored "-Wunused-function"
 #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
 
-#include <stdio.h>
-#include <stdlib.h>
-
 // comment next line to disable assertions
 #define DEBUG
 #include "poly/thread.h"
 #include "poly/scalar.h"
 #include "poly/passing/port.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+
 ////////////////////////////////////////////////////////////////////////
 // Generate 2,3,5,7,9...
 ////////////////////////////////////////////////////////////////////////
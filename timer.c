@@ -0,0 +1,52 @@
+// Timer wheel test: timers around the cascade of the second level
+// gcc -Wall -O2 timer.c -lpthread
+
+#define DEBUG
+#include "poly/timer.h"
+
+#include <stdio.h>
+
+enum { N=3 };
+
+static Clock fired[N];
+
+static void ring(void* argument)
+{
+	fired[(long)argument] = now();
+}
+
+int main(int argc, char* argv[argc+1])
+{
+	TimerWheel wheel;
+	int err = timer_wheel_init(&wheel, ms2ns(10));
+	assert(err == STATUS_SUCCESS);
+	Clock const resolution = wheel.resolution;
+
+	// start at the beginning of a block: the timers go to the second level
+	Clock tick;
+	while (((tick=now()/resolution) & (TIMER_SLOTS-1)) != 2) {
+		thread_sleep(resolution/4);
+	}
+	Clock const boundary = (tick | (TIMER_SLOTS-1)) + 1 + TIMER_SLOTS;
+	Clock const due[N] = { boundary-1, boundary, boundary+5 };
+
+	Timer timer[N];
+	for (long i = 0; i < N; ++i) {
+		fired[i] = 0;
+		timer_init(&timer[i], ring, (void*)i);
+		timer_start(&wheel, &timer[i], due[i]*resolution, 0);
+	}
+	thread_sleep((due[N-1] - tick + 8) * resolution);
+
+	for (int i = 0; i < N; ++i) {
+		Clock const late = fired[i] - due[i]*resolution;
+		printf("boundary%+lld: %lld ms late\n", due[i]-boundary, ns2ms(late));
+		assert(fired[i] != 0);
+		assert(late >= 0 && late < resolution/2);
+	}
+	timer_wheel_destroy(&wheel);
+
+	return 0;
+}
+
+// vim:ai:sw=4:ts=4:syntax=cpp